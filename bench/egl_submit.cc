@@ -0,0 +1,154 @@
+// cost of submitting a frame through EGL, without a compositor. runs on mesa's
+// software rasterizer by default, so numbers are comparable between machines.
+// set GALLIUM_DRIVER to benchmark a hardware driver instead
+
+#include <array>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+// a pbuffer on the surfaceless platform stands in for the wayland surface,
+// eglSwapBuffers is a no-op on it, so glFinish waits for the rasterizer instead
+class Pbuffer {
+    EGLDisplay m_display = EGL_NO_DISPLAY;
+    EGLContext m_context = EGL_NO_CONTEXT;
+    EGLSurface m_surface = EGL_NO_SURFACE;
+
+public:
+    Pbuffer(int width, int height) {
+        setenv("GALLIUM_DRIVER", "llvmpipe", 0);
+
+        auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (get_platform_display == nullptr) return;
+
+        m_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, nullptr, nullptr)) return;
+
+        eglBindAPI(EGL_OPENGL_API);
+
+        constexpr std::array config_attribs {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE, 8,
+            EGL_ALPHA_SIZE, 8,
+            EGL_NONE
+        };
+
+        EGLConfig config;
+        EGLint count = 0;
+        if (!eglChooseConfig(m_display, config_attribs.data(), &config, 1, &count) || count == 0) return;
+
+        m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, nullptr);
+
+        std::array surface_attribs { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+        m_surface = eglCreatePbufferSurface(m_display, config, surface_attribs.data());
+
+        eglMakeCurrent(m_display, m_surface, m_surface, m_context);
+
+        // the first frame compiles llvmpipe's shaders, which would skew the first run
+        glClear(GL_COLOR_BUFFER_BIT);
+        glFinish();
+    }
+
+    Pbuffer(const Pbuffer&) = delete;
+    Pbuffer& operator=(const Pbuffer&) = delete;
+
+    ~Pbuffer() {
+        if (m_display == EGL_NO_DISPLAY) return;
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (m_surface != EGL_NO_SURFACE) eglDestroySurface(m_display, m_surface);
+        if (m_context != EGL_NO_CONTEXT) eglDestroyContext(m_display, m_context);
+        eglTerminate(m_display);
+    }
+
+    [[nodiscard]] bool valid() const {
+        return m_surface != EGL_NO_SURFACE && m_context != EGL_NO_CONTEXT;
+    }
+
+    [[nodiscard]] std::string_view renderer() const {
+        return reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    }
+
+    void swap() const {
+        eglSwapBuffers(m_display, m_surface);
+    }
+};
+
+void buffer_sizes(benchmark::internal::Benchmark* bench) {
+    bench->Args({ 1280, 720 })->Args({ 1920, 1080 })->Args({ 3840, 2160 });
+}
+
+// what render_frame does for a window without a draw function
+void BM_egl_clear_submit(benchmark::State& state) {
+    int width = state.range(0);
+    int height = state.range(1);
+
+    Pbuffer pbuffer(width, height);
+    if (!pbuffer.valid()) {
+        state.SkipWithError("no surfaceless EGL display");
+        return;
+    }
+    state.SetLabel(std::string(pbuffer.renderer()));
+
+    float shade = 0.0f;
+    for (auto _ : state) {
+        // a changing color, so nothing can be skipped as redundant
+        shade = shade >= 1.0f ? 0.0f : shade + 0.01f;
+        glClearColor(shade, shade, shade, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        pbuffer.swap();
+        glFinish();
+    }
+
+    state.counters["fps"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_egl_clear_submit)->Apply(buffer_sizes)->UseRealTime();
+
+// scissored clears approximate a frame of many small quads, one command each
+void BM_egl_quads_submit(benchmark::State& state) {
+    int width = 1920;
+    int height = 1080;
+    int quads = state.range(0);
+
+    Pbuffer pbuffer(width, height);
+    if (!pbuffer.valid()) {
+        state.SkipWithError("no surfaceless EGL display");
+        return;
+    }
+    state.SetLabel(std::string(pbuffer.renderer()));
+
+    glEnable(GL_SCISSOR_TEST);
+    for (auto _ : state) {
+        glScissor(0, 0, width, height);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        for (int i = 0; i < quads; ++i) {
+            glScissor((i * 37) % (width - 64), (i * 23) % (height - 64), 64, 64);
+            glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
+
+        pbuffer.swap();
+        glFinish();
+    }
+    glDisable(GL_SCISSOR_TEST);
+
+    state.counters["fps"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_egl_quads_submit)->Arg(16)->Arg(256)->Arg(4096)->UseRealTime();
+
+} // namespace
@@ -0,0 +1,281 @@
+// end-to-end frames per second, one iteration per frame: draw, commit and wait for the frame callback.
+// runs against the compositor from WAYLAND_DISPLAY, meant to be a headless one (see bench/headless.sh),
+// and against the in-process mock compositor, which sends frame callbacks right away and so
+// measures only the client's side, deterministically and without a display
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <optional>
+#include <string>
+
+#include <wayland-client.h>
+#include <wayland-egl.h>
+#include <EGL/egl.h>
+#include "xdg-shell.h"
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../util.h"
+#include "../shm.h"
+#include "../mock_compositor.h"
+
+namespace {
+
+constexpr int width = 1920;
+constexpr int height = 1080;
+
+enum class Target { Compositor, Mock };
+
+// a mapped xdg toplevel on its own connection
+class Client {
+    std::optional<mock::Compositor> m_mock;
+
+    struct wl_display* m_wl_display = nullptr;
+    struct wl_registry* m_wl_registry = nullptr;
+    struct wl_compositor* m_wl_compositor = nullptr;
+    struct wl_shm* m_wl_shm = nullptr;
+    struct xdg_wm_base* m_xdg_wm_base = nullptr;
+
+    struct wl_surface* m_wl_surface = nullptr;
+    struct xdg_surface* m_xdg_surface = nullptr;
+    struct xdg_toplevel* m_xdg_toplevel = nullptr;
+
+    bool m_configured = false;
+    bool m_frame_done = false;
+
+public:
+    explicit Client(Target target) {
+        if (target == Target::Mock) {
+            m_mock.emplace();
+            m_wl_display = wl_display_connect_to_fd(m_mock->connect_client());
+        } else {
+            m_wl_display = wl_display_connect(nullptr);
+        }
+        if (m_wl_display == nullptr) return;
+
+        m_wl_registry = wl_display_get_registry(m_wl_display);
+        wl_registry_add_listener(m_wl_registry, &m_registry_listener, this);
+        wl_display_roundtrip(m_wl_display);
+
+        if (m_wl_compositor == nullptr || m_wl_shm == nullptr || m_xdg_wm_base == nullptr) return;
+
+        xdg_wm_base_add_listener(m_xdg_wm_base, &m_xdg_wm_base_listener, nullptr);
+
+        m_wl_surface = wl_compositor_create_surface(m_wl_compositor);
+        m_xdg_surface = xdg_wm_base_get_xdg_surface(m_xdg_wm_base, m_wl_surface);
+        xdg_surface_add_listener(m_xdg_surface, &m_xdg_surface_listener, this);
+        m_xdg_toplevel = xdg_surface_get_toplevel(m_xdg_surface);
+        xdg_toplevel_set_title(m_xdg_toplevel, "frame_rate benchmark");
+        wl_surface_commit(m_wl_surface);
+
+        while (!m_configured && wl_display_dispatch(m_wl_display) != -1);
+    }
+
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    ~Client() {
+        if (m_wl_display == nullptr) return;
+        if (m_xdg_toplevel != nullptr) xdg_toplevel_destroy(m_xdg_toplevel);
+        if (m_xdg_surface != nullptr) xdg_surface_destroy(m_xdg_surface);
+        if (m_wl_surface != nullptr) wl_surface_destroy(m_wl_surface);
+        if (m_xdg_wm_base != nullptr) xdg_wm_base_destroy(m_xdg_wm_base);
+        if (m_wl_shm != nullptr) wl_shm_destroy(m_wl_shm);
+        if (m_wl_compositor != nullptr) wl_compositor_destroy(m_wl_compositor);
+        wl_registry_destroy(m_wl_registry);
+        wl_display_disconnect(m_wl_display);
+    }
+
+    [[nodiscard]] bool valid() const {
+        return m_configured;
+    }
+
+    [[nodiscard]] struct wl_display* display() const {
+        return m_wl_display;
+    }
+
+    [[nodiscard]] struct wl_surface* surface() const {
+        return m_wl_surface;
+    }
+
+    [[nodiscard]] struct wl_shm* shm() const {
+        return m_wl_shm;
+    }
+
+    // must be called before the commit of the frame it should wait for
+    void request_frame() {
+        m_frame_done = false;
+        struct wl_callback* frame_callback = wl_surface_frame(m_wl_surface);
+        wl_callback_add_listener(frame_callback, &m_frame_callback_listener, this);
+    }
+
+    // returns false if the connection was lost
+    [[nodiscard]] bool wait_frame() {
+        while (!m_frame_done) {
+            if (wl_display_dispatch(m_wl_display) == -1)
+                return false;
+        }
+        return true;
+    }
+
+private:
+    // wl_surface.damage_buffer needs wl_compositor v4
+    static void registry_global(void* data, struct wl_registry* wl_registry, uint32_t name, const char* interface, uint32_t version) {
+        Client& client = *static_cast<Client*>(data);
+
+        util::LazyStringSwitch(interface)
+            .case_(wl_compositor_interface.name, [&] {
+                client.m_wl_compositor = static_cast<struct wl_compositor*>(wl_registry_bind(wl_registry, name, &wl_compositor_interface, std::min(version, 4u)));
+            })
+
+            .case_(wl_shm_interface.name, [&] {
+                client.m_wl_shm = static_cast<struct wl_shm*>(wl_registry_bind(wl_registry, name, &wl_shm_interface, 1));
+            })
+
+            .case_(xdg_wm_base_interface.name, [&] {
+                client.m_xdg_wm_base = static_cast<struct xdg_wm_base*>(wl_registry_bind(wl_registry, name, &xdg_wm_base_interface, 1));
+            });
+    }
+
+    static void xdg_surface_configure(void* data, struct xdg_surface* xdg_surface, uint32_t serial) {
+        Client& client = *static_cast<Client*>(data);
+        xdg_surface_ack_configure(xdg_surface, serial);
+        client.m_configured = true;
+    }
+
+    static void frame_done(void* data, struct wl_callback* wl_callback, [[maybe_unused]] uint32_t callback_data) {
+        Client& client = *static_cast<Client*>(data);
+        wl_callback_destroy(wl_callback);
+        client.m_frame_done = true;
+    }
+
+    static inline const struct wl_registry_listener m_registry_listener {
+        .global = registry_global,
+        .global_remove = util::DefaultConstructedFunction<decltype(wl_registry_listener::global_remove)>::value,
+    };
+
+    static inline const struct xdg_wm_base_listener m_xdg_wm_base_listener {
+        .ping = []([[maybe_unused]] void* data, struct xdg_wm_base* xdg_wm_base, uint32_t serial) {
+            xdg_wm_base_pong(xdg_wm_base, serial);
+        }
+    };
+
+    static inline const struct xdg_surface_listener m_xdg_surface_listener {
+        .configure = xdg_surface_configure,
+    };
+
+    static inline const struct wl_callback_listener m_frame_callback_listener {
+        .done = frame_done,
+    };
+};
+
+const struct wl_buffer_listener buffer_listener {
+    .release = []([[maybe_unused]] void* data, struct wl_buffer* wl_buffer) {
+        wl_buffer_destroy(wl_buffer);
+    }
+};
+
+// the simple_example path: a new shm buffer per frame
+template <Target target>
+void BM_frame_rate_shm(benchmark::State& state) {
+    Client client(target);
+    if (!client.valid()) {
+        state.SkipWithError("no compositor with wl_shm and xdg_wm_base, is WAYLAND_DISPLAY set?");
+        return;
+    }
+
+    for (auto _ : state) {
+        client.request_frame();
+
+        util::ShmMapping mapping(width, height);
+        struct wl_buffer* buffer = mapping.create_buffer(client.shm(), width, height);
+        wl_buffer_add_listener(buffer, &buffer_listener, nullptr);
+        util::fill_frame(mapping.pixels(), width, height, 1.0f);
+
+        wl_surface_attach(client.surface(), buffer, 0, 0);
+        wl_surface_damage_buffer(client.surface(), 0, 0, std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max());
+        wl_surface_commit(client.surface());
+
+        if (!client.wait_frame()) {
+            state.SkipWithError("lost the connection to the compositor");
+            break;
+        }
+    }
+
+    state.counters["fps"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_frame_rate_shm<Target::Compositor>)->Name("frame_rate_shm/compositor")->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_frame_rate_shm<Target::Mock>)->Name("frame_rate_shm/mock")->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// the wayland_app path: an EGL window surface with swap interval 0, paced by frame callbacks
+template <Target target>
+void BM_frame_rate_egl(benchmark::State& state) {
+    Client client(target);
+    if (!client.valid()) {
+        state.SkipWithError("no compositor with wl_shm and xdg_wm_base, is WAYLAND_DISPLAY set?");
+        return;
+    }
+
+    EGLDisplay egl_display = eglGetDisplay(client.display());
+    if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, nullptr, nullptr)) {
+        state.SkipWithError("failed to initialize EGL");
+        return;
+    }
+    eglBindAPI(EGL_OPENGL_API);
+
+    constexpr std::array config_attribs {
+        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint count = 0;
+    eglChooseConfig(egl_display, config_attribs.data(), &config, 1, &count);
+    EGLContext context = count == 0 ? EGL_NO_CONTEXT : eglCreateContext(egl_display, config, EGL_NO_CONTEXT, nullptr);
+    if (context == EGL_NO_CONTEXT) {
+        state.SkipWithError("failed to create an EGL context");
+        eglTerminate(egl_display);
+        return;
+    }
+
+    struct wl_egl_window* egl_window = wl_egl_window_create(client.surface(), width, height);
+    EGLSurface egl_surface = eglCreateWindowSurface(egl_display, config, egl_window, nullptr);
+    eglMakeCurrent(egl_display, egl_surface, egl_surface, context);
+    eglSwapInterval(egl_display, 0);
+    state.SetLabel(reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+
+    float shade = 0.0f;
+    for (auto _ : state) {
+        client.request_frame();
+
+        shade = shade >= 1.0f ? 0.0f : shade + 0.01f;
+        glClearColor(shade, shade, shade, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        eglSwapBuffers(egl_display, egl_surface);
+
+        if (!client.wait_frame()) {
+            state.SkipWithError("lost the connection to the compositor");
+            break;
+        }
+    }
+
+    state.counters["fps"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+
+    eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroySurface(egl_display, egl_surface);
+    wl_egl_window_destroy(egl_window);
+    eglDestroyContext(egl_display, context);
+    eglTerminate(egl_display);
+}
+BENCHMARK(BM_frame_rate_egl<Target::Compositor>)->Name("frame_rate_egl/compositor")->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_frame_rate_egl<Target::Mock>)->Name("frame_rate_egl/mock")->UseRealTime()->Unit(benchmark::kMillisecond);
+
+} // namespace
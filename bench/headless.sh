@@ -0,0 +1,32 @@
+#!/bin/sh
+# runs a command against a private headless weston instance
+# usage: bench/headless.sh <command> [args...]
+set -e
+
+SOCKET=wayland-bench-$$
+
+if ! command -v weston >/dev/null 2>&1; then
+    echo "weston not found, running against WAYLAND_DISPLAY=${WAYLAND_DISPLAY:-<unset>}" >&2
+    exec "$@"
+fi
+
+export XDG_RUNTIME_DIR=${XDG_RUNTIME_DIR:-$(mktemp -d)}
+
+# clients render on the cpu, which keeps the numbers comparable between machines
+weston --backend=headless --socket="$SOCKET" \
+    --width=1920 --height=1080 --idle-time=0 >/dev/null 2>&1 &
+WESTON=$!
+trap 'kill $WESTON 2>/dev/null; wait $WESTON 2>/dev/null || true' EXIT
+
+# wait for the socket, at most 5 seconds
+i=0
+while [ ! -S "$XDG_RUNTIME_DIR/$SOCKET" ]; do
+    i=$((i + 1))
+    if [ $i -gt 50 ] || ! kill -0 $WESTON 2>/dev/null; then
+        echo "weston failed to start" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+WAYLAND_DISPLAY=$SOCKET LIBGL_ALWAYS_SOFTWARE=1 "$@"
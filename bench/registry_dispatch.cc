@@ -0,0 +1,77 @@
+// compares the registry dispatch in bind_globals before and after switching
+// from util::StringSwitch<std::function<void()>> to util::PerfectHashMap
+
+#include <array>
+#include <functional>
+#include <string_view>
+
+#include <benchmark/benchmark.h>
+
+#include "../util.h"
+
+namespace {
+
+// globals advertised by a typical wlroots-based compositor
+constexpr std::array advertised_globals {
+    "wl_shm", "wl_drm", "zwp_linux_dmabuf_v1", "wl_compositor", "wl_subcompositor",
+    "wl_data_device_manager", "zwlr_gamma_control_manager_v1", "zxdg_output_manager_v1",
+    "ext_idle_notifier_v1", "zwp_idle_inhibit_manager_v1", "zwlr_layer_shell_v1",
+    "xdg_wm_base", "zwp_tablet_manager_v2", "org_kde_kwin_server_decoration_manager",
+    "zxdg_decoration_manager_v1", "zwp_relative_pointer_manager_v1",
+    "zwp_pointer_constraints_v1", "wp_presentation", "zwlr_output_manager_v1",
+    "zwlr_output_power_manager_v1", "zwp_input_method_manager_v2",
+    "zwp_text_input_manager_v3", "zwlr_foreign_toplevel_manager_v1",
+    "ext_session_lock_manager_v1", "wp_drm_lease_device_v1", "zwlr_export_dmabuf_manager_v1",
+    "zwlr_screencopy_manager_v1", "zwlr_data_control_manager_v1",
+    "wp_security_context_manager_v1", "wp_viewporter", "wp_single_pixel_buffer_manager_v1",
+    "zxdg_exporter_v1", "zxdg_importer_v1", "zxdg_exporter_v2", "zxdg_importer_v2",
+    "wp_fractional_scale_manager_v1", "wp_cursor_shape_manager_v1",
+    "wp_tearing_control_manager_v1", "wp_content_type_manager_v1",
+    "xdg_activation_v1", "ext_foreign_toplevel_list_v1", "zwp_pointer_gestures_v1",
+    "zwp_primary_selection_device_manager_v1", "zwp_virtual_keyboard_manager_v1",
+    "zwlr_virtual_pointer_manager_v1", "zwp_keyboard_shortcuts_inhibit_manager_v1",
+    "wp_alpha_modifier_v1", "ext_data_control_manager_v1", "wl_seat", "wl_output",
+};
+
+int bound = 0;
+
+void dispatch_string_switch(std::string_view interface) {
+    util::StringSwitch<std::function<void()>>(interface)
+        .case_("wl_compositor", [&] { ++bound; })
+        .case_("xdg_wm_base", [&] { ++bound; })
+        .case_("wl_seat", [&] { ++bound; })
+        .case_("zwlr_layer_shell_v1", [&] { ++bound; })
+        .default_([] { })
+        .done()();
+}
+
+void dispatch_perfect_hash(std::string_view interface) {
+    static constexpr util::PerfectHashMap<void(*)(), 4> binders({{
+        { "wl_compositor", [] { ++bound; } },
+        { "xdg_wm_base", [] { ++bound; } },
+        { "wl_seat", [] { ++bound; } },
+        { "zwlr_layer_shell_v1", [] { ++bound; } },
+    }});
+
+    if (auto bind = binders.find(interface))
+        (*bind)();
+}
+
+template <void(*Dispatch)(std::string_view)>
+void BM_registry_dispatch(benchmark::State& state) {
+    bound = 0;
+
+    for (auto _ : state) {
+        for (std::string_view interface : advertised_globals)
+            Dispatch(interface);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * advertised_globals.size());
+    state.counters["bound"] = benchmark::Counter(bound, benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK(BM_registry_dispatch<dispatch_string_switch>)->Name("registry_dispatch/StringSwitch");
+BENCHMARK(BM_registry_dispatch<dispatch_perfect_hash>)->Name("registry_dispatch/PerfectHashMap");
+
+} // namespace
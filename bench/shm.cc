@@ -0,0 +1,55 @@
+// cost of the simple_example frame path that doesn't need a compositor:
+// allocating a shm file per frame and filling it with the test pattern
+
+#include <benchmark/benchmark.h>
+
+#include "../shm.h"
+
+namespace {
+
+// buffer sizes in pixels: 720p, 1080p, 1440p, 4k
+void buffer_sizes(benchmark::internal::Benchmark* bench) {
+    bench->Args({ 1280, 720 })->Args({ 1920, 1080 })->Args({ 2560, 1440 })->Args({ 3840, 2160 });
+}
+
+void BM_shm_create(benchmark::State& state) {
+    int width = state.range(0);
+    int height = state.range(1);
+
+    for (auto _ : state) {
+        util::ShmMapping mapping(width, height);
+        benchmark::DoNotOptimize(mapping.pixels().data());
+    }
+}
+BENCHMARK(BM_shm_create)->Apply(buffer_sizes);
+
+// the first write to every page of a new mapping faults it in, which is what each frame pays
+void BM_shm_create_and_touch(benchmark::State& state) {
+    int width = state.range(0);
+    int height = state.range(1);
+
+    for (auto _ : state) {
+        util::ShmMapping mapping(width, height);
+        auto pixels = mapping.pixels();
+        for (size_t i = 0; i < pixels.size(); i += 4096 / sizeof(uint32_t))
+            pixels[i] = 0;
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_shm_create_and_touch)->Apply(buffer_sizes);
+
+void BM_fill_frame(benchmark::State& state) {
+    int width = state.range(0);
+    int height = state.range(1);
+    util::ShmMapping mapping(width, height);
+
+    for (auto _ : state) {
+        util::fill_frame(mapping.pixels(), width, height, 1.0f);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetBytesProcessed(state.iterations() * width * height * util::ShmMapping::stride);
+}
+BENCHMARK(BM_fill_frame)->Apply(buffer_sizes);
+
+} // namespace
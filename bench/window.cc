@@ -0,0 +1,259 @@
+// WaylandWindow against the in-process mock compositor: the client's whole side of a frame, from the
+// frame callback through the draw function to eglSwapBuffers, deterministically and without a display
+
+#include <algorithm>
+#include <cstdlib>
+#include <optional>
+
+#include <benchmark/benchmark.h>
+#include <gfx/gfx.h>
+
+#include "../wayland.h"
+#include "../mock_compositor.h"
+#include "../offscreen.h"
+
+namespace {
+
+// the mock has no wl_drm or dmabuf, and software rendering keeps the results independent of the gpu
+const bool software_rendering = [] {
+    setenv("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+    return true;
+}();
+
+// destroyed in reverse, so the window goes before the connection and the connection before the compositor
+struct Fixture {
+    mock::Compositor compositor;
+    wayland::WaylandConnection connection;
+    wayland::WaylandWindow window;
+    uint64_t frames = 0;
+
+    explicit Fixture(mock::Compositor::Options options = {})
+        : compositor(std::move(options))
+        , connection(compositor.connect_client())
+        , window(connection, "window benchmark", {}, wayland::Opacity::Opaque)
+    {
+        window.set_draw_fn([this](gfx::Renderer& rd) {
+            rd.clear_background(gfx::Color::blue());
+            rd.draw_rectangle(0, 0, 300, 300, gfx::Color::orange());
+            rd.draw_circle(rd.get_surface().get_center(), 150, gfx::Color::red());
+            ++frames;
+        });
+    }
+
+    // waits for a frame, at the given width if it isn't 0. returns false if the connection was lost
+    [[nodiscard]] bool next_frame(int width = 0) {
+        uint64_t drawn = frames;
+        while (frames == drawn || (width != 0 && window.get_width() != width)) {
+            if (!connection.dispatch())
+                return false;
+        }
+        return true;
+    }
+};
+
+void BM_window_frame(benchmark::State& state) {
+    Fixture fixture;
+
+    for (auto _ : state) {
+        if (!fixture.next_frame()) {
+            state.SkipWithError("lost the connection to the mock compositor");
+            break;
+        }
+    }
+
+    state.counters["fps"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_window_frame)->UseRealTime();
+
+// the same scene without a compositor, into an offscreen surface of width x height. glFinish makes every
+// iteration wait for the frame, like the swap does for the window, so this is the draw function's cost alone
+void BM_offscreen_frame(benchmark::State& state) {
+    offscreen::OffscreenSurface surface(state.range(0), state.range(1));
+    auto draw = [](gfx::Renderer& rd) {
+        rd.clear_background(gfx::Color::blue());
+        rd.draw_rectangle(0, 0, 300, 300, gfx::Color::orange());
+        rd.draw_circle(rd.get_surface().get_center(), 150, gfx::Color::red());
+    };
+
+    for (auto _ : state) {
+        surface.draw(draw);
+        surface.finish();
+    }
+
+    state.counters["fps"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_offscreen_frame)->Args({ 1280, 720 })->Args({ 1920, 1080 })->UseRealTime();
+
+// BM_offscreen_frame with every frame captured to a ppm stream in /dev/null, so the difference is the cost
+// of capturing on the render thread. readback is that cost per frame, encode what the encoder thread spends per frame
+void BM_offscreen_capture(benchmark::State& state) {
+    offscreen::OffscreenSurface surface(state.range(0), state.range(1));
+    auto draw = [](gfx::Renderer& rd) {
+        rd.clear_background(gfx::Color::blue());
+        rd.draw_rectangle(0, 0, 300, 300, gfx::Color::orange());
+        rd.draw_circle(rd.get_surface().get_center(), 150, gfx::Color::red());
+    };
+
+    std::optional<capture::Capture> capture(std::in_place, capture::Options { .path = "/dev/null", .format = capture::Format::Stream });
+    for (auto _ : state) {
+        surface.draw(draw);
+        capture->capture(surface.get_width(), surface.get_height());
+        surface.finish();
+    }
+
+    surface.make_current();
+    capture->finish();
+    auto stats = capture->stats();
+    capture.reset();
+
+    using us = std::chrono::duration<double, std::micro>;
+    double captured = std::max<double>(stats.captured, 1);
+    double written = std::max<double>(stats.written, 1);
+    state.counters["fps"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+    state.counters["dropped"] = stats.dropped;
+    state.counters["readback_us"] = us(stats.readback).count() / captured;
+    state.counters["encode_us"] = us(stats.encode).count() / written;
+}
+BENCHMARK(BM_offscreen_capture)->Args({ 1280, 720 })->Args({ 1920, 1080 })->UseRealTime();
+
+// configure to the first frame at the new size, which reallocates the EGL window's buffers
+void BM_window_resize(benchmark::State& state) {
+    Fixture fixture;
+    bool large = false;
+
+    for (auto _ : state) {
+        large = !large;
+        int width = large ? 1920 : 1280;
+        fixture.compositor.configure(width, large ? 1080 : 720);
+
+        if (!fixture.next_frame(width)) {
+            state.SkipWithError("lost the connection to the mock compositor");
+            break;
+        }
+    }
+
+    auto stats = fixture.compositor.stats();
+    state.counters["configures"] = stats.configures;
+    state.counters["acks"] = stats.acks;
+}
+BENCHMARK(BM_window_resize)->UseRealTime();
+
+// plugging in a second output with twice the scale and unplugging it again, each up to the first frame at the
+// scale that follows. tests/hotplug.cc checks that this works, here it is only timed
+void BM_output_hotplug(benchmark::State& state) {
+    Fixture fixture;
+    if (!fixture.next_frame()) {
+        state.SkipWithError("lost the connection to the mock compositor");
+        return;
+    }
+    int width = fixture.window.get_width();
+
+    // the output is bound, and the window enters it, a few roundtrips after it was plugged in
+    auto frame_at = [&](int expected) {
+        for (int frame = 0; frame < 10; ++frame) {
+            if (!fixture.next_frame())
+                return false;
+            if (fixture.window.get_width() == expected)
+                return true;
+        }
+        return false;
+    };
+
+    for (auto _ : state) {
+        uint32_t output = fixture.compositor.add_output({ .scale = 2 });
+        if (!frame_at(width * 2)) {
+            state.SkipWithError("the window didn't follow the scale of the new output");
+            break;
+        }
+
+        fixture.compositor.remove_output(output);
+        if (!frame_at(width)) {
+            state.SkipWithError("the window didn't leave the unplugged output");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_output_hotplug)->UseRealTime();
+
+// BM_output_hotplug with an OutputOverlay, up to the first frame after the overlay's surface for the new output
+// was created and after it was destroyed again. tests/hotplug.cc checks the overlay, here it is only timed
+void BM_overlay_hotplug(benchmark::State& state) {
+    Fixture fixture;
+    wayland::OutputOverlay overlay(fixture.connection, "overlay benchmark", wayland::Opacity::Translucent, [](gfx::Renderer& rd, const wayland::WaylandConnection::Output&) {
+        rd.clear_background(gfx::Color::red());
+    });
+    if (!fixture.next_frame()) {
+        state.SkipWithError("lost the connection to the mock compositor");
+        return;
+    }
+    uint64_t surfaces = fixture.compositor.stats().surfaces;
+
+    // the compositor sees surfaces created and destroyed with the next flush, which the next frame does
+    auto frame_with = [&](auto&& surface_count_matches) {
+        for (int frame = 0; frame < 10; ++frame) {
+            if (!fixture.next_frame())
+                return false;
+            if (surface_count_matches(fixture.compositor.stats().surfaces))
+                return true;
+        }
+        return false;
+    };
+
+    for (auto _ : state) {
+        uint32_t output = fixture.compositor.add_output({ .refresh = 144000 });
+        if (!frame_with([&](uint64_t count) { return count > surfaces; })) {
+            state.SkipWithError("the overlay didn't create a surface on the new output");
+            break;
+        }
+
+        fixture.compositor.remove_output(output);
+        if (!frame_with([&](uint64_t count) { return count == surfaces; })) {
+            state.SkipWithError("the overlay didn't destroy the surface of the unplugged output");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_overlay_hotplug)->UseRealTime();
+
+// a session recorded with WaylandConnection::record_events(), from the path in BENCH_REPLAY. each iteration
+// replays all of it, as fast as the window renders. only the first window's events are replayed
+void BM_window_replay(benchmark::State& state) {
+    const char* path = std::getenv("BENCH_REPLAY");
+    if (path == nullptr) {
+        state.SkipWithError("set BENCH_REPLAY to a recording to replay");
+        return;
+    }
+
+    auto events = replay::load(path);
+    if (!events) {
+        state.SkipWithError("failed to read the recording");
+        return;
+    }
+    std::erase_if(*events, [](const replay::Event& event) {
+        return event.window != 0 && event.type != replay::EventType::Key;
+    });
+
+    // the first configure draws a frame, then every frame callback does
+    auto frames = std::ranges::count(*events, replay::EventType::Frame, &replay::Event::type) + 1;
+
+    std::optional<Fixture> fixture;
+    for (auto _ : state) {
+        state.PauseTiming();
+        fixture.reset();
+        fixture.emplace(mock::Compositor::Options { .replay = *events });
+        state.ResumeTiming();
+
+        while (fixture->frames < static_cast<uint64_t>(frames)) {
+            if (!fixture->connection.dispatch()) {
+                state.SkipWithError("lost the connection to the mock compositor");
+                return;
+            }
+        }
+    }
+
+    state.counters["frames"] = frames;
+    state.counters["fps"] = benchmark::Counter(static_cast<double>(frames) * state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_window_replay)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+} // namespace
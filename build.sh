@@ -1,12 +1,31 @@
 #!/bin/sh
+# wrapper around the cmake build, see CMakeLists.txt
+# usage: ./build.sh [debug|release|relwithdebinfo|lto|pgo]
 set -e
 
-wayland-scanner private-code xdg-shell.xml xdg-shell.c
-wayland-scanner client-header xdg-shell.xml xdg-shell.h
+BUILD_DIR=${BUILD_DIR:-build}
+MODE=${1:-relwithdebinfo}
 
-wayland-scanner private-code wlr-layer-shell-unstable-v1.xml wlr-layer-shell-unstable-v1.c
-wayland-scanner client-header wlr-layer-shell-unstable-v1.xml wlr-layer-shell-unstable-v1.h
+configure() {
+    cmake -S . -B "$BUILD_DIR" "$@"
+}
 
-cc xdg-shell.c -c
-cc wlr-layer-shell-unstable-v1.c -c
-c++ -Wall -Wextra -I./glad/include/ main.cc xdg-shell.o wlr-layer-shell-unstable-v1.o -std=c++23 `pkg-config --libs --cflags wayland-client` -lEGL -lwayland-egl -lGL -ggdb -lgfx `pkg-config --cflags --libs freetype2`
+case "$MODE" in
+    debug)          configure -DCMAKE_BUILD_TYPE=Debug -DENABLE_LTO=OFF -DPGO=OFF ;;
+    release)        configure -DCMAKE_BUILD_TYPE=Release -DENABLE_LTO=OFF -DPGO=OFF ;;
+    relwithdebinfo) configure -DCMAKE_BUILD_TYPE=RelWithDebInfo -DENABLE_LTO=OFF -DPGO=OFF ;;
+    lto)            configure -DCMAKE_BUILD_TYPE=Release -DENABLE_LTO=ON -DPGO=OFF ;;
+    pgo)
+        # instrument, train on the benchmarks, then rebuild with the collected profiles
+        rm -rf "$BUILD_DIR/pgo-profiles"
+        configure -DCMAKE_BUILD_TYPE=Release -DENABLE_LTO=ON -DPGO=GENERATE
+        cmake --build "$BUILD_DIR" --target pgo-train -j"$(nproc)"
+        configure -DPGO=USE
+        ;;
+    *)
+        echo "usage: $0 [debug|release|relwithdebinfo|lto|pgo]" >&2
+        exit 1
+        ;;
+esac
+
+cmake --build "$BUILD_DIR" -j"$(nproc)"
@@ -0,0 +1,419 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <mutex>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#ifdef WAYLAND_CAPTURE_PNG
+#include <csetjmp>
+
+#include <png.h>
+#endif
+
+#include "frame_profiler.h"
+#include "memory.h"
+
+// records what was rendered without stalling the render thread: frames are read back into a ring of persistently
+// mapped pixel buffer objects, and once their fence signalled a few frames later, an encoder thread writes them
+// out straight from the mapping. frames are dropped rather than waited for, when the gpu or the encoder falls behind
+namespace capture {
+
+enum class Format {
+    Ppm,    // a file per frame in the directory at path
+    Png,    // a file per frame in the directory at path, only with WAYLAND_CAPTURE_PNG (cmake -DCAPTURE_PNG=ON)
+    Stream, // every frame into the file at path, as concatenated ppm images, e.g. for ffmpeg -f image2pipe
+};
+
+struct Options {
+    std::string path;
+    Format format = Format::Ppm;
+    // frames in flight or waiting for the encoder, each one has its own buffer
+    size_t depth = 4;
+};
+
+struct Stats {
+    uint64_t captured = 0;
+    // because every buffer was still in flight or waiting for the encoder
+    uint64_t dropped = 0;
+    uint64_t written = 0;
+    uint64_t failed = 0;
+    // on the render thread, starting readbacks and handing them to the encoder
+    std::chrono::nanoseconds readback{0};
+    // on the encoder thread
+    std::chrono::nanoseconds encode{0};
+};
+
+// RGBA8, bottom row first as GL reads it
+struct Frame {
+    uint64_t index = 0;
+    int width = 0;
+    int height = 0;
+    const uint8_t* pixels = nullptr;
+    // cleared once the frame is written, which hands its buffer back for the next readback
+    std::atomic<bool>* busy = nullptr;
+};
+
+namespace detail {
+
+inline bool write_ppm(std::FILE* file, const Frame& frame) {
+    std::string header = std::format("P6\n{} {}\n255\n", frame.width, frame.height);
+    if (std::fwrite(header.data(), 1, header.size(), file) != header.size()) return false;
+
+    std::vector<uint8_t> row(static_cast<size_t>(frame.width) * 3);
+    for (int y = frame.height - 1; y >= 0; --y) {
+        const uint8_t* pixel = frame.pixels + static_cast<size_t>(y) * frame.width * 4;
+        for (int x = 0; x < frame.width; ++x, pixel += 4) {
+            row[x * 3 + 0] = pixel[0];
+            row[x * 3 + 1] = pixel[1];
+            row[x * 3 + 2] = pixel[2];
+        }
+        if (std::fwrite(row.data(), 1, row.size(), file) != row.size()) return false;
+    }
+    return true;
+}
+
+#ifdef WAYLAND_CAPTURE_PNG
+// keeps the alpha channel, for windows that aren't opaque
+inline bool write_png(std::FILE* file, const Frame& frame) {
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = png != nullptr ? png_create_info_struct(png) : nullptr;
+    if (info == nullptr) {
+        png_destroy_write_struct(&png, nullptr);
+        return false;
+    }
+
+    // libpng reports errors by jumping back here
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        return false;
+    }
+
+    png_init_io(png, file);
+    // fast over small, the encoder has to keep up with the frame rate
+    png_set_compression_level(png, 1);
+    png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+    png_set_IHDR(png, info, frame.width, frame.height, 8, PNG_COLOR_TYPE_RGBA,
+        PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+    png_write_info(png, info);
+
+    for (int y = frame.height - 1; y >= 0; --y)
+        png_write_row(png, frame.pixels + static_cast<size_t>(y) * frame.width * 4);
+
+    png_write_end(png, nullptr);
+    png_destroy_write_struct(&png, &info);
+    return true;
+}
+#endif
+
+} // namespace detail
+
+// writes frames on its own thread, in the order they were queued. the destructor writes the ones still queued
+class Encoder {
+    Options m_options;
+    std::FILE* m_stream = nullptr;
+
+    // guards everything below
+    std::mutex m_mutex;
+    std::condition_variable m_queued;
+    std::deque<Frame> m_queue;
+    bool m_stopping = false;
+    uint64_t m_written = 0;
+    uint64_t m_failed = 0;
+    std::chrono::nanoseconds m_encode{0};
+
+    std::thread m_thread;
+
+public:
+    explicit Encoder(Options options)
+        : m_options(std::move(options))
+    {
+        if (m_options.format == Format::Stream) {
+            m_stream = std::fopen(m_options.path.c_str(), "wb");
+            if (m_stream == nullptr)
+                throw std::runtime_error(std::format("failed to open {} for capturing", m_options.path));
+        } else {
+#ifndef WAYLAND_CAPTURE_PNG
+            if (m_options.format == Format::Png)
+                throw std::runtime_error("capturing to png needs a build with -DCAPTURE_PNG=ON");
+#endif
+            std::filesystem::create_directories(m_options.path);
+        }
+
+        m_thread = std::thread([this] { run(); });
+    }
+
+    Encoder(const Encoder&) = delete;
+    Encoder& operator=(const Encoder&) = delete;
+
+    ~Encoder() {
+        stop();
+        if (m_stream != nullptr) std::fclose(m_stream);
+    }
+
+    // writes the frames still queued and ends the thread
+    void stop() {
+        if (!m_thread.joinable()) return;
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_queued.notify_one();
+        m_thread.join();
+    }
+
+    void queue(Frame frame) {
+        {
+            std::lock_guard lock(m_mutex);
+            m_queue.push_back(std::move(frame));
+        }
+        m_queued.notify_one();
+    }
+
+    // adds what the encoder thread counts to stats
+    void add_stats(Stats& stats) {
+        std::lock_guard lock(m_mutex);
+        stats.written += m_written;
+        stats.failed += m_failed;
+        stats.encode += m_encode;
+    }
+
+private:
+    void run() {
+        std::unique_lock lock(m_mutex);
+        while (true) {
+            m_queued.wait(lock, [&] { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty()) return;
+
+            Frame frame = std::move(m_queue.front());
+            m_queue.pop_front();
+            lock.unlock();
+
+            auto start = util::monotonic_now();
+            bool written = write(frame);
+            auto duration = util::monotonic_now() - start;
+            frame.busy->store(false, std::memory_order_release);
+
+            lock.lock();
+            (written ? m_written : m_failed) += 1;
+            m_encode += duration;
+        }
+    }
+
+    [[nodiscard]] bool write(const Frame& frame) {
+        if (m_options.format == Format::Stream)
+            return detail::write_ppm(m_stream, frame);
+
+        const char* extension = m_options.format == Format::Png ? "png" : "ppm";
+        std::string path = std::format("{}/{:06}.{}", m_options.path, frame.index, extension);
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr) return false;
+
+#ifdef WAYLAND_CAPTURE_PNG
+        bool written = m_options.format == Format::Png ? detail::write_png(file, frame) : detail::write_ppm(file, frame);
+#else
+        bool written = detail::write_ppm(file, frame);
+#endif
+        return std::fclose(file) == 0 && written;
+    }
+};
+
+// reads back the framebuffer of a GL context, which has to be 4.4 or have ARB_buffer_storage.
+// every call needs that context current, including the destructor
+class Capture {
+    struct Slot {
+        GLuint buffer = 0;
+        size_t size = 0;
+        // persistently and coherently, so the encoder reads the pixels where the gpu wrote them
+        const uint8_t* mapped = nullptr;
+        // set while the readback is in flight
+        GLsync fence = nullptr;
+        // from the readback until the encoder wrote the frame
+        std::atomic<bool> busy = false;
+        uint64_t index = 0;
+        int width = 0;
+        int height = 0;
+    };
+
+    size_t m_depth;
+    // lowered by reduce_depth(), the slots above it are freed once they aren't in use
+    size_t m_target_depth;
+    std::unique_ptr<Slot[]> m_slots;
+    // the slot the next readback goes to, which is also the oldest one in flight
+    size_t m_next = 0;
+    uint64_t m_frames = 0;
+    Stats m_stats;
+    util::memory::Allocation m_memory { util::memory::Subsystem::Readback };
+
+    Encoder m_encoder;
+
+public:
+    explicit Capture(Options options)
+        : m_depth(std::max<size_t>(options.depth, 1))
+        , m_target_depth(m_depth)
+        , m_slots(std::make_unique<Slot[]>(m_depth))
+        , m_encoder(std::move(options))
+    { }
+
+    Capture(const Capture&) = delete;
+    Capture& operator=(const Capture&) = delete;
+
+    // frames still in flight are dropped, queued ones are still written
+    ~Capture() {
+        // the encoder reads from the buffers until it's done
+        m_encoder.stop();
+
+        for (size_t i = 0; i < m_depth; ++i) {
+            if (m_slots[i].fence != nullptr) glDeleteSync(m_slots[i].fence);
+            if (m_slots[i].buffer != 0) glDeleteBuffers(1, &m_slots[i].buffer);
+        }
+    }
+
+    // starts reading back the bound read framebuffer, after the frame has been drawn into it
+    void capture(int width, int height) {
+        // nothing to read, e.g. before the first configure
+        if (width <= 0 || height <= 0) return;
+
+        auto start = util::monotonic_now();
+        collect(false);
+        if (m_target_depth < m_depth)
+            shrink();
+
+        Slot& slot = m_slots[m_next];
+        size_t size = static_cast<size_t>(width) * height * 4;
+        if (slot.busy.load(std::memory_order_acquire) || (slot.size != size && !allocate(slot, size))) {
+            ++m_stats.dropped;
+            m_stats.readback += util::monotonic_now() - start;
+            return;
+        }
+
+        // returns right away, the copy into the buffer happens on the gpu
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.busy.store(true, std::memory_order_relaxed);
+        slot.index = m_frames++;
+        slot.width = width;
+        slot.height = height;
+        m_next = (m_next + 1) % m_depth;
+
+        m_stats.readback += util::monotonic_now() - start;
+    }
+
+    // waits for the readbacks in flight and queues them, e.g. before the capture is destroyed
+    void finish() {
+        auto start = util::monotonic_now();
+        collect(true);
+        m_stats.readback += util::monotonic_now() - start;
+    }
+
+    // fewer frames can be in flight or waiting for the encoder, which drops more of them when it falls behind
+    void reduce_depth(size_t depth) {
+        m_target_depth = std::clamp<size_t>(depth, 1, m_target_depth);
+    }
+
+    [[nodiscard]] Stats stats() {
+        Stats stats = m_stats;
+        m_encoder.add_stats(stats);
+        return stats;
+    }
+
+private:
+    // the storage of a buffer is immutable, so a new size needs a new buffer
+    bool allocate(Slot& slot, size_t size) {
+        // deleting a buffer unmaps it
+        if (slot.buffer != 0)
+            glDeleteBuffers(1, &slot.buffer);
+        slot.size = 0;
+
+        constexpr GLbitfield access = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        // only ever read by the cpu, so it's best kept in system memory
+        glBufferStorage(GL_PIXEL_PACK_BUFFER, size, nullptr, access | GL_CLIENT_STORAGE_BIT);
+        slot.mapped = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, access));
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        slot.size = slot.mapped != nullptr ? size : 0;
+        update_memory();
+        return slot.mapped != nullptr;
+    }
+
+    // only once the slots above the target depth are free and the ring doesn't wrap around them
+    void shrink() {
+        if (m_next >= m_target_depth) return;
+        for (size_t i = m_target_depth; i < m_depth; ++i) {
+            if (m_slots[i].busy.load(std::memory_order_acquire)) return;
+        }
+
+        for (size_t i = m_target_depth; i < m_depth; ++i) {
+            if (m_slots[i].buffer != 0) glDeleteBuffers(1, &m_slots[i].buffer);
+            m_slots[i].buffer = 0;
+            m_slots[i].size = 0;
+        }
+        m_depth = m_target_depth;
+        update_memory();
+    }
+
+    void update_memory() {
+        size_t bytes = 0;
+        for (size_t i = 0; i < m_depth; ++i)
+            bytes += m_slots[i].size;
+        m_memory.resize(bytes);
+    }
+
+    // fences signal in order, so this stops at the first readback that hasn't finished
+    void collect(bool wait) {
+        for (size_t i = 0; i < m_depth; ++i) {
+            Slot& slot = m_slots[(m_next + i) % m_depth];
+            if (slot.fence == nullptr) continue;
+
+            GLenum status = wait
+                ? glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED)
+                : glClientWaitSync(slot.fence, 0, 0);
+            if (status == GL_TIMEOUT_EXPIRED) return;
+
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+
+            if (status == GL_WAIT_FAILED) {
+                slot.busy.store(false, std::memory_order_relaxed);
+                ++m_stats.dropped;
+                continue;
+            }
+
+            ++m_stats.captured;
+            m_encoder.queue({ slot.index, slot.width, slot.height, slot.mapped, &slot.busy });
+        }
+    }
+};
+
+// one line, the times per captured frame
+[[nodiscard]] inline std::string format(const Stats& stats) {
+    using ms = std::chrono::duration<double, std::milli>;
+    auto per_frame = [&](std::chrono::nanoseconds time) {
+        return stats.captured == 0 ? 0.0 : ms(time).count() / stats.captured;
+    };
+
+    return std::format("capture: {} captured, {} dropped, {} written, {} failed, {:.3f} ms readback, {:.3f} ms encode per frame\n",
+        stats.captured, stats.dropped, stats.written, stats.failed, per_frame(stats.readback), per_frame(stats.encode));
+}
+
+} // namespace capture
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <format>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "memory.h"
+
+namespace util {
+
+// the clock every phase of a frame is timed with
+[[nodiscard]] inline std::chrono::nanoseconds monotonic_now() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return std::chrono::seconds(now.tv_sec) + std::chrono::nanoseconds(now.tv_nsec);
+}
+
+// nearest-rank percentile of already sorted values
+template <typename T>
+[[nodiscard]] constexpr T percentile(std::span<const T> sorted, unsigned percent) {
+    if (sorted.empty()) return T{};
+    size_t rank = (percent * sorted.size() + 99) / 100;
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+// per-phase timings of the most recent frames of a window. written by the thread rendering the
+// window and readable from any other thread without locking, through a seqlock per record
+class FrameProfiler {
+public:
+    enum class Phase { Dispatch, Draw, Submit, Swap, Commit };
+    static constexpr size_t phase_count = 5;
+    static constexpr std::array<std::string_view, phase_count> phase_names { "dispatch", "draw", "submit", "swap", "commit" };
+
+    struct Record {
+        uint64_t frame = 0;
+        std::array<std::chrono::nanoseconds, phase_count> phases{};
+        // gpu time of the draw function, only with timer queries and once their result is in
+        std::optional<std::chrono::nanoseconds> gpu{};
+
+        [[nodiscard]] constexpr std::chrono::nanoseconds total() const {
+            std::chrono::nanoseconds total{0};
+            for (auto phase : phases)
+                total += phase;
+            return total;
+        }
+    };
+
+    struct Percentiles {
+        std::chrono::nanoseconds p50{0};
+        std::chrono::nanoseconds p95{0};
+        std::chrono::nanoseconds p99{0};
+    };
+
+    struct Summary {
+        size_t frames = 0;
+        std::array<Percentiles, phase_count> phases{};
+        Percentiles total{};
+        // over the frames that have a gpu time
+        size_t gpu_frames = 0;
+        Percentiles gpu{};
+    };
+
+private:
+    // the sequence is odd while the slot is written. everything is atomic, so readers never race the writer
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        std::array<std::atomic<int64_t>, phase_count> phases{};
+        std::atomic<int64_t> gpu{-1};
+    };
+    static_assert(std::atomic<int64_t>::is_always_lock_free);
+
+    size_t m_capacity;
+    std::unique_ptr<Slot[]> m_slots;
+    // number of frames published, the next frame's number
+    std::atomic<uint64_t> m_frames{0};
+
+    // only touched by the writer
+    Record m_current;
+
+    memory::Allocation m_memory;
+
+public:
+    explicit FrameProfiler(size_t capacity = 1024)
+        : m_capacity(capacity)
+        , m_slots(std::make_unique<Slot[]>(capacity))
+        , m_memory(memory::Subsystem::Instrumentation, capacity * sizeof(Slot))
+    { }
+
+    FrameProfiler(const FrameProfiler&) = delete;
+    FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+    // ---- writer ----
+
+    // starts the record of the next frame and returns its number
+    uint64_t begin_frame() {
+        m_current = { .frame = m_frames.load(std::memory_order_relaxed) };
+        return m_current.frame;
+    }
+
+    // phases can be added to more than once per frame
+    void add(Phase phase, std::chrono::nanoseconds duration) {
+        m_current.phases[static_cast<size_t>(phase)] += duration;
+    }
+
+    void end_frame() {
+        Slot& slot = slot_of(m_current.frame);
+        begin_write(slot, m_current.frame);
+        for (size_t i = 0; i < phase_count; ++i)
+            slot.phases[i].store(m_current.phases[i].count(), std::memory_order_relaxed);
+        slot.gpu.store(-1, std::memory_order_relaxed);
+        end_write(slot, m_current.frame);
+
+        m_frames.store(m_current.frame + 1, std::memory_order_release);
+    }
+
+    // timer query results arrive frames later, they are dropped once the frame has left the ring
+    void set_gpu_time(uint64_t frame, std::chrono::nanoseconds duration) {
+        if (frame >= m_frames.load(std::memory_order_relaxed) || frame + m_capacity < m_frames.load(std::memory_order_relaxed))
+            return;
+
+        Slot& slot = slot_of(frame);
+        begin_write(slot, frame);
+        slot.gpu.store(duration.count(), std::memory_order_relaxed);
+        end_write(slot, frame);
+    }
+
+    // ---- readers ----
+
+    // oldest first, records that are being overwritten while reading are skipped
+    [[nodiscard]] std::vector<Record> records() const {
+        uint64_t end = m_frames.load(std::memory_order_acquire);
+        uint64_t begin = end > m_capacity ? end - m_capacity : 0;
+
+        std::vector<Record> records;
+        records.reserve(end - begin);
+
+        for (uint64_t frame = begin; frame < end; ++frame) {
+            const Slot& slot = slot_of(frame);
+
+            uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if (sequence != complete(frame)) continue;
+
+            Record record { .frame = frame };
+            for (size_t i = 0; i < phase_count; ++i)
+                record.phases[i] = std::chrono::nanoseconds(slot.phases[i].load(std::memory_order_relaxed));
+            int64_t gpu = slot.gpu.load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != sequence) continue;
+
+            if (gpu >= 0)
+                record.gpu = std::chrono::nanoseconds(gpu);
+            records.push_back(record);
+        }
+
+        return records;
+    }
+
+    [[nodiscard]] Summary summary() const {
+        auto records = this->records();
+        return summarize(records);
+    }
+
+    [[nodiscard]] static constexpr Summary summarize(std::span<const Record> records) {
+        Summary summary { .frames = records.size() };
+
+        auto percentiles = [](std::vector<std::chrono::nanoseconds> values) {
+            std::ranges::sort(values);
+            return Percentiles {
+                percentile<std::chrono::nanoseconds>(values, 50),
+                percentile<std::chrono::nanoseconds>(values, 95),
+                percentile<std::chrono::nanoseconds>(values, 99),
+            };
+        };
+
+        for (size_t i = 0; i < phase_count; ++i) {
+            std::vector<std::chrono::nanoseconds> values;
+            for (const Record& record : records)
+                values.push_back(record.phases[i]);
+            summary.phases[i] = percentiles(std::move(values));
+        }
+
+        std::vector<std::chrono::nanoseconds> totals, gpu;
+        for (const Record& record : records) {
+            totals.push_back(record.total());
+            if (record.gpu)
+                gpu.push_back(*record.gpu);
+        }
+        summary.total = percentiles(std::move(totals));
+        summary.gpu_frames = gpu.size();
+        summary.gpu = percentiles(std::move(gpu));
+
+        return summary;
+    }
+
+    // a table in milliseconds, one row per phase
+    [[nodiscard]] static std::string format(const Summary& summary) {
+        auto row = [](std::string_view name, const Percentiles& percentiles) {
+            using ms = std::chrono::duration<double, std::milli>;
+            return std::format("  {:<8} {:8.3f} {:8.3f} {:8.3f}\n", name,
+                ms(percentiles.p50).count(), ms(percentiles.p95).count(), ms(percentiles.p99).count());
+        };
+
+        std::string table = std::format("{} frames, in ms {:>8} {:>8} {:>8}\n", summary.frames, "p50", "p95", "p99");
+        for (size_t i = 0; i < phase_count; ++i)
+            table += row(phase_names[i], summary.phases[i]);
+        table += row("total", summary.total);
+        if (summary.gpu_frames != 0)
+            table += row("gpu", summary.gpu);
+        return table;
+    }
+
+private:
+    [[nodiscard]] static constexpr uint64_t complete(uint64_t frame) {
+        return 2 * frame + 2;
+    }
+
+    [[nodiscard]] Slot& slot_of(uint64_t frame) const {
+        return m_slots[frame % m_capacity];
+    }
+
+    static void begin_write(Slot& slot, uint64_t frame) {
+        slot.sequence.store(complete(frame) - 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    static void end_write(Slot& slot, uint64_t frame) {
+        slot.sequence.store(complete(frame), std::memory_order_release);
+    }
+};
+
+consteval void test_frame_profiler() {
+    using namespace std::chrono_literals;
+
+    static_assert(percentile<int>(std::array { 1, 2, 3, 4 }, 50) == 2);
+    static_assert(percentile<int>(std::array { 1, 2, 3, 4 }, 99) == 4);
+    static_assert(percentile<int>(std::array { 7 }, 0) == 7);
+    static_assert(percentile<int>(std::span<const int>{}, 50) == 0);
+
+    static_assert([] {
+        std::array<FrameProfiler::Record, 100> records{};
+        for (int i = 0; i < 100; ++i) {
+            records[i].phases[static_cast<size_t>(FrameProfiler::Phase::Draw)] = std::chrono::milliseconds(i + 1);
+            records[i].phases[static_cast<size_t>(FrameProfiler::Phase::Swap)] = 1ms;
+        }
+        records[0].gpu = 2ms;
+
+        auto summary = FrameProfiler::summarize(records);
+        const auto& draw = summary.phases[static_cast<size_t>(FrameProfiler::Phase::Draw)];
+        return summary.frames == 100
+            && draw.p50 == 50ms && draw.p95 == 95ms && draw.p99 == 99ms
+            && summary.total.p99 == 100ms
+            && summary.gpu_frames == 1 && summary.gpu.p50 == 2ms;
+    }());
+
+    // no frames yet
+    static_assert(FrameProfiler::summarize({}).total.p99 == 0ns);
+}
+
+} // namespace util
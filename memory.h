@@ -0,0 +1,151 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// the bytes held per subsystem, process-wide. objects add what they hold through an Allocation, which is
+// updated when they grow or shrink and removes its bytes when destroyed. GPU memory is estimated from sizes,
+// memory inside libraries (mesa, gfx) and the heap behind std::function closures isn't seen at all
+namespace util::memory {
+
+enum class Subsystem {
+    Shm,             // util::ShmMapping
+    Surfaces,        // EGL window surfaces, estimated
+    Readback,        // capture::Capture pixel buffers
+    Instrumentation, // frame profiler rings, event recordings
+    Tracing,         // util::trace buffers, kept until they are written at exit and not counted against a budget
+};
+inline constexpr size_t subsystem_count = 5;
+inline constexpr std::array<std::string_view, subsystem_count> subsystem_names { "shm pools", "egl surfaces", "readback", "instrumentation", "tracing" };
+
+// buffers mesa keeps per EGL window surface. it can't be queried, up to 4 are allocated when the compositor
+// holds on to buffers, and ones that went unused for a while are freed again
+inline constexpr size_t surface_buffers = 3;
+
+[[nodiscard]] constexpr size_t surface_bytes(int width, int height) {
+    return static_cast<size_t>(width) * height * 4 * surface_buffers;
+}
+
+struct Usage {
+    std::array<size_t, subsystem_count> bytes{};
+    // the most each subsystem held at once since the process started
+    std::array<size_t, subsystem_count> peak{};
+
+    [[nodiscard]] constexpr size_t total() const {
+        size_t total = 0;
+        for (size_t bytes : bytes)
+            total += bytes;
+        return total;
+    }
+
+    // what a memory budget is checked against. trace buffers can't be trimmed, with tracing
+    // switched on a small budget would otherwise stay exceeded for good
+    [[nodiscard]] constexpr size_t budgeted() const {
+        return total() - bytes[static_cast<size_t>(Subsystem::Tracing)];
+    }
+};
+
+namespace detail {
+
+struct State {
+    std::array<std::atomic<size_t>, subsystem_count> bytes{};
+    std::array<std::atomic<size_t>, subsystem_count> peak{};
+};
+
+inline State& state() {
+    static State state;
+    return state;
+}
+
+inline void add(Subsystem subsystem, size_t added, size_t removed) {
+    State& state = detail::state();
+    auto index = static_cast<size_t>(subsystem);
+
+    // wraps around to subtract when shrinking
+    size_t bytes = state.bytes[index].fetch_add(added - removed, std::memory_order_relaxed) + added - removed;
+    size_t peak = state.peak[index].load(std::memory_order_relaxed);
+    while (bytes > peak && !state.peak[index].compare_exchange_weak(peak, bytes, std::memory_order_relaxed));
+}
+
+} // namespace detail
+
+// the bytes one object holds in a subsystem
+class Allocation {
+    Subsystem m_subsystem;
+    size_t m_bytes = 0;
+
+public:
+    explicit Allocation(Subsystem subsystem, size_t bytes = 0)
+        : m_subsystem(subsystem)
+    {
+        resize(bytes);
+    }
+
+    Allocation(Allocation&& other) noexcept
+        : m_subsystem(other.m_subsystem)
+        , m_bytes(std::exchange(other.m_bytes, 0))
+    { }
+
+    Allocation& operator=(Allocation&& other) noexcept {
+        if (this != &other) {
+            resize(0);
+            m_subsystem = other.m_subsystem;
+            m_bytes = std::exchange(other.m_bytes, 0);
+        }
+        return *this;
+    }
+
+    ~Allocation() {
+        resize(0);
+    }
+
+    void resize(size_t bytes) {
+        if (bytes == m_bytes) return;
+        detail::add(m_subsystem, bytes, m_bytes);
+        m_bytes = bytes;
+    }
+
+    [[nodiscard]] size_t bytes() const {
+        return m_bytes;
+    }
+};
+
+[[nodiscard]] inline Usage usage() {
+    detail::State& state = detail::state();
+    Usage usage;
+    for (size_t i = 0; i < subsystem_count; ++i) {
+        usage.bytes[i] = state.bytes[i].load(std::memory_order_relaxed);
+        usage.peak[i] = state.peak[i].load(std::memory_order_relaxed);
+    }
+    return usage;
+}
+
+// a table in MiB, one row per subsystem
+[[nodiscard]] inline std::string format(const Usage& usage, std::optional<size_t> budget = std::nullopt) {
+    auto mib = [](size_t bytes) { return bytes / (1024.0 * 1024.0); };
+
+    std::string table = std::format("memory, in MiB   {:>10} {:>10}\n", "current", "peak");
+    for (size_t i = 0; i < subsystem_count; ++i)
+        table += std::format("  {:<15} {:10.1f} {:10.1f}\n", subsystem_names[i], mib(usage.bytes[i]), mib(usage.peak[i]));
+
+    table += std::format("  {:<15} {:10.1f}\n", "total", mib(usage.total()));
+    if (budget)
+        table += std::format("  {:<15} {:10.1f} of a {:.1f} budget\n", "budgeted", mib(usage.budgeted()), mib(*budget));
+    return table;
+}
+
+consteval void test_memory() {
+    static_assert(surface_bytes(1920, 1080) == 1920 * 1080 * 4 * surface_buffers);
+    static_assert(Usage{}.total() == 0);
+    static_assert(Usage { .bytes = { 1, 2, 3, 4, 5 }, .peak = { 10, 10, 10, 10, 10 } }.total() == 15);
+    static_assert(Usage { .bytes = { 1, 2, 3, 4, 5 }, .peak = { 10, 10, 10, 10, 10 } }.budgeted() == 10);
+}
+
+} // namespace util::memory
@@ -0,0 +1,930 @@
+#include "mock_compositor.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <wayland-server.h>
+#include "xdg-shell-server.h"
+#include "wlr-layer-shell-unstable-v1-server.h"
+#include "viewporter-server.h"
+#include "fractional-scale-v1-server.h"
+
+#include "util.h"
+
+namespace mock {
+
+class Compositor::Server {
+    enum class Role { None, Toplevel, Popup, Layer, Subsurface };
+
+    struct Surface;
+
+    struct OutputGlobal {
+        Server& server;
+        uint32_t id;
+        Output mode;
+        wl_global* global = nullptr;
+        // unplugged, but kept until the display is destroyed as clients may still bind it
+        bool removed = false;
+        std::vector<wl_resource*> resources{};
+    };
+
+    // a buffer that was attached but not committed yet, forgotten if the client destroys it in between
+    struct PendingBuffer {
+        // first member, so the listener can be cast back
+        wl_listener destroy_listener{};
+        wl_resource* resource = nullptr;
+        bool attached = false;
+
+        void set(wl_resource* buffer) {
+            clear();
+            attached = true;
+            resource = buffer;
+            if (resource == nullptr) return;
+
+            destroy_listener.notify = [](wl_listener* listener, void*) {
+                PendingBuffer& self = *reinterpret_cast<PendingBuffer*>(listener);
+                wl_list_remove(&self.destroy_listener.link);
+                self.resource = nullptr;
+            };
+            wl_resource_add_destroy_listener(resource, &destroy_listener);
+        }
+
+        void clear() {
+            if (resource != nullptr)
+                wl_list_remove(&destroy_listener.link);
+            resource = nullptr;
+            attached = false;
+        }
+    };
+
+    struct Surface {
+        Server& server;
+        wl_resource* resource;
+        Role role = Role::None;
+        wl_resource* xdg_surface = nullptr;
+        // xdg_toplevel, xdg_popup or zwlr_layer_surface_v1
+        wl_resource* role_resource = nullptr;
+        bool configure_sent = false;
+        // what the client asked for through the positioner or zwlr_layer_surface_v1.set_size
+        int32_t requested_width = 0;
+        int32_t requested_height = 0;
+        // toplevels and layer surfaces are numbered in the order they got their role, to match them with a replay
+        std::optional<uint32_t> window{};
+        bool committed = false;
+        wl_resource* fractional_scale = nullptr;
+        // the output a layer surface asked for, nullptr to be shown on every output
+        OutputGlobal* output = nullptr;
+        // entered the outputs it is shown on, which happens with the first configure of a toplevel or layer surface
+        bool entered = false;
+
+        PendingBuffer pending_buffer{};
+        // requested since the last commit
+        std::vector<wl_resource*> pending_frames{};
+        // committed, sent with the next frame
+        std::vector<wl_resource*> frames{};
+    };
+
+    struct Positioner {
+        int32_t width = 0;
+        int32_t height = 0;
+    };
+
+    Options m_options;
+    // virtual time of the last frame, in the clock domain of the frame callback timestamps
+    std::chrono::nanoseconds m_clock{0};
+    size_t m_next_scripted = 0;
+    size_t m_next_replayed = 0;
+    uint32_t m_next_window = 0;
+    Stats m_stats;
+
+    wl_display* m_display = nullptr;
+    wl_event_loop* m_loop = nullptr;
+    wl_event_source* m_frame_timer_source = nullptr;
+    int m_frame_timer = -1;
+    // wakes the thread up to stop
+    int m_wake = -1;
+
+    // indexed by id, unique_ptr as the wl_output resources point to them
+    std::vector<std::unique_ptr<OutputGlobal>> m_outputs;
+    std::vector<Surface*> m_surfaces;
+    std::vector<wl_resource*> m_keyboards;
+
+    // guards everything above against the calls from the client's thread
+    mutable std::mutex m_mutex;
+    bool m_stop = false;
+    std::thread m_thread;
+
+public:
+    explicit Server(Options options) : m_options(std::move(options)) {
+        m_display = wl_display_create();
+        if (m_display == nullptr)
+            throw std::runtime_error("failed to create the mock wayland display");
+
+        m_loop = wl_display_get_event_loop(m_display);
+        wl_display_init_shm(m_display);
+
+        // v6 for wl_surface.preferred_buffer_scale
+        wl_global_create(m_display, &wl_compositor_interface, 6, this, bind_compositor);
+        wl_global_create(m_display, &wl_subcompositor_interface, 1, this, bind_subcompositor);
+        create_output({
+            .width = m_options.output_width,
+            .height = m_options.output_height,
+            .refresh = m_options.output_refresh,
+            .scale = 1,
+        });
+        wl_global_create(m_display, &wl_seat_interface, 5, this, bind_seat);
+        wl_global_create(m_display, &xdg_wm_base_interface, xdg_wm_base_interface.version, this, bind_xdg_wm_base);
+        wl_global_create(m_display, &zwlr_layer_shell_v1_interface, zwlr_layer_shell_v1_interface.version, this, bind_layer_shell);
+        wl_global_create(m_display, &wp_viewporter_interface, 1, this, bind_viewporter);
+        wl_global_create(m_display, &wp_fractional_scale_manager_v1_interface, 1, this, bind_fractional_scale_manager);
+
+        if (m_options.frame_interval.count() > 0) {
+            m_frame_timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+            auto seconds = std::chrono::duration_cast<std::chrono::seconds>(m_options.frame_interval);
+            timespec interval {
+                .tv_sec = seconds.count(),
+                .tv_nsec = (m_options.frame_interval - seconds).count(),
+            };
+            itimerspec spec { .it_interval = interval, .it_value = interval };
+            timerfd_settime(m_frame_timer, 0, &spec, nullptr);
+
+            m_frame_timer_source = wl_event_loop_add_fd(m_loop, m_frame_timer, WL_EVENT_READABLE, frame_timer_expired, this);
+        }
+
+        m_wake = eventfd(0, EFD_CLOEXEC);
+        m_thread = std::thread([this] { run(); });
+    }
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    ~Server() {
+        {
+            std::scoped_lock lock(m_mutex);
+            m_stop = true;
+        }
+        uint64_t one = 1;
+        write(m_wake, &one, sizeof(one));
+        m_thread.join();
+
+        // destroys every resource, and with them all surfaces
+        wl_display_destroy_clients(m_display);
+        if (m_frame_timer_source != nullptr)
+            wl_event_source_remove(m_frame_timer_source);
+        wl_display_destroy(m_display);
+
+        if (m_frame_timer != -1)
+            close(m_frame_timer);
+        close(m_wake);
+    }
+
+    [[nodiscard]] int connect_client() {
+        std::array<int, 2> fds;
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data()) == -1)
+            throw std::runtime_error("failed to create a socket pair for the mock compositor");
+
+        std::scoped_lock lock(m_mutex);
+        if (wl_client_create(m_display, fds[0]) == nullptr) {
+            close(fds[0]);
+            close(fds[1]);
+            throw std::runtime_error("failed to create a mock wayland client");
+        }
+        return fds[1];
+    }
+
+    void configure(int32_t width, int32_t height) {
+        std::scoped_lock lock(m_mutex);
+        configure_all(width, height);
+        wl_display_flush_clients(m_display);
+    }
+
+    uint32_t add_output(Output output) {
+        std::scoped_lock lock(m_mutex);
+        uint32_t id = create_output(output);
+        wl_display_flush_clients(m_display);
+        return id;
+    }
+
+    void remove_output(uint32_t id) {
+        std::scoped_lock lock(m_mutex);
+        if (id >= m_outputs.size() || m_outputs[id]->removed) return;
+
+        OutputGlobal& output = *m_outputs[id];
+        output.removed = true;
+
+        for (Surface* surface : m_surfaces) {
+            if (!surface->entered) continue;
+            for (wl_resource* resource : output.resources) {
+                if (wl_resource_get_client(resource) == wl_resource_get_client(surface->resource))
+                    wl_surface_send_leave(surface->resource, resource);
+            }
+        }
+
+        wl_global_remove(output.global);
+        wl_display_flush_clients(m_display);
+    }
+
+    [[nodiscard]] Stats stats() const {
+        std::scoped_lock lock(m_mutex);
+        Stats stats = m_stats;
+        stats.surfaces = m_surfaces.size();
+        return stats;
+    }
+
+private:
+    void run() {
+        std::array fds {
+            pollfd { .fd = wl_event_loop_get_fd(m_loop), .events = POLLIN, .revents = 0 },
+            pollfd { .fd = m_wake, .events = POLLIN, .revents = 0 },
+        };
+
+        while (true) {
+            poll(fds.data(), fds.size(), -1);
+
+            std::scoped_lock lock(m_mutex);
+            if (m_stop) return;
+
+            wl_event_loop_dispatch(m_loop, 0);
+            advance_replay();
+            wl_display_flush_clients(m_display);
+        }
+    }
+
+    [[nodiscard]] bool replaying() const {
+        return !m_options.replay.empty();
+    }
+
+    // ---- frames ----------------------------------------------------------------
+
+    [[nodiscard]] std::chrono::nanoseconds frame_period() const {
+        if (m_options.frame_interval.count() > 0)
+            return m_options.frame_interval;
+        return std::chrono::nanoseconds(1'000'000'000'000 / m_options.output_refresh);
+    }
+
+    // returns true if there was a callback to send
+    bool send_frames(Surface& surface, uint32_t time) {
+        if (surface.frames.empty()) return false;
+
+        for (wl_resource* callback : std::exchange(surface.frames, {})) {
+            // done destroys the callback, which must not find its surface anymore
+            wl_resource_set_user_data(callback, nullptr);
+            wl_callback_send_done(callback, time);
+            wl_resource_destroy(callback);
+        }
+        return true;
+    }
+
+    // sends the frame callbacks of the given surfaces as one frame
+    template <typename Surfaces>
+    void present(Surfaces&& surfaces) {
+        auto clock = m_clock + frame_period();
+        uint32_t time = std::chrono::duration_cast<std::chrono::milliseconds>(clock).count();
+
+        bool sent = false;
+        for (Surface* surface : surfaces)
+            sent |= send_frames(*surface, time);
+
+        // the clock only advances with frames, so timestamps don't depend on how fast the client is
+        if (!sent) return;
+        m_clock = clock;
+        ++m_stats.frames;
+
+        while (m_next_scripted < m_options.script.size() && m_options.script[m_next_scripted].frame <= m_stats.frames) {
+            const ScriptedConfigure& scripted = m_options.script[m_next_scripted++];
+            configure_all(scripted.width, scripted.height);
+        }
+    }
+
+    static int frame_timer_expired(int fd, [[maybe_unused]] uint32_t mask, void* data) {
+        Server& server = *static_cast<Server*>(data);
+
+        uint64_t expirations;
+        read(fd, &expirations, sizeof(expirations));
+
+        // a replay sends the frames of the recording instead
+        if (!server.replaying())
+            server.present(server.m_surfaces);
+        return 0;
+    }
+
+    // ---- replay ----------------------------------------------------------------
+
+    [[nodiscard]] Surface* window_surface(uint32_t window) const {
+        auto it = std::ranges::find(m_surfaces, std::optional(window), &Surface::window);
+        return it != m_surfaces.end() ? *it : nullptr;
+    }
+
+    // sends the recorded events in order, for as long as the client is ready for the next one
+    void advance_replay() {
+        while (m_next_replayed < m_options.replay.size()) {
+            const replay::Event& event = m_options.replay[m_next_replayed];
+            uint32_t time = std::chrono::duration_cast<std::chrono::milliseconds>(event.time).count();
+
+            if (event.type == replay::EventType::Key) {
+                // the client doesn't track keyboard focus, so there is no enter
+                for (wl_resource* keyboard : m_keyboards)
+                    wl_keyboard_send_key(keyboard, wl_display_next_serial(m_display), time, event.args[0], event.args[1]);
+            } else {
+                // configures need the initial commit, frames a frame callback to send
+                Surface* surface = window_surface(event.window);
+                if (surface == nullptr || !surface->committed) return;
+                if (event.type == replay::EventType::Frame && surface->frames.empty()) return;
+
+                switch (event.type) {
+                    case replay::EventType::Configure:
+                        send_configure(*surface, event.args[0], event.args[1]);
+                        break;
+
+                    case replay::EventType::Frame:
+                        // along with the surfaces that aren't windows, e.g. popups and subsurfaces
+                        for (Surface* other : m_surfaces) {
+                            if (other == surface || !other->window)
+                                send_frames(*other, time);
+                        }
+                        m_clock = event.time;
+                        ++m_stats.frames;
+                        break;
+
+                    case replay::EventType::PreferredScale:
+                        if (wl_resource_get_version(surface->resource) >= WL_SURFACE_PREFERRED_BUFFER_SCALE_SINCE_VERSION)
+                            wl_surface_send_preferred_buffer_scale(surface->resource, event.args[0]);
+                        break;
+
+                    case replay::EventType::FractionalScale:
+                        if (surface->fractional_scale != nullptr)
+                            wp_fractional_scale_v1_send_preferred_scale(surface->fractional_scale, event.args[0]);
+                        break;
+
+                    case replay::EventType::Key:
+                        break;
+                }
+            }
+
+            ++m_next_replayed;
+            ++m_stats.replayed;
+        }
+    }
+
+    // ---- configures ------------------------------------------------------------
+
+    void send_configure(Surface& surface, int32_t width, int32_t height) {
+        if (surface.role_resource == nullptr) return;
+
+        // before the configure, so the client knows its scale for the first buffer
+        if (!surface.entered && (surface.role == Role::Toplevel || surface.role == Role::Layer))
+            enter_outputs(surface);
+
+        uint32_t serial = wl_display_next_serial(m_display);
+
+        switch (surface.role) {
+            case Role::Toplevel: {
+                wl_array states;
+                wl_array_init(&states);
+                xdg_toplevel_send_configure(surface.role_resource, width, height, &states);
+                wl_array_release(&states);
+                xdg_surface_send_configure(surface.xdg_surface, serial);
+            } break;
+
+            case Role::Popup:
+                xdg_popup_send_configure(surface.role_resource, 0, 0, surface.requested_width, surface.requested_height);
+                xdg_surface_send_configure(surface.xdg_surface, serial);
+                break;
+
+            case Role::Layer: {
+                // a layer surface that left the size to us is stretched over its output, or the first one
+                const Output& output = surface.output != nullptr ? surface.output->mode : m_outputs.front()->mode;
+                zwlr_layer_surface_v1_send_configure(surface.role_resource, serial,
+                    width != 0 ? width : surface.requested_width != 0 ? surface.requested_width : output.width,
+                    height != 0 ? height : surface.requested_height != 0 ? surface.requested_height : output.height);
+            } break;
+
+            case Role::None:
+            case Role::Subsurface:
+                return;
+        }
+
+        surface.configure_sent = true;
+        ++m_stats.configures;
+    }
+
+    void configure_all(int32_t width, int32_t height) {
+        // surfaces created from now on start out at this size too
+        m_options.width = width;
+        m_options.height = height;
+
+        for (Surface* surface : m_surfaces) {
+            if (surface->role == Role::Toplevel || surface->role == Role::Layer)
+                send_configure(*surface, width, height);
+        }
+    }
+
+    // ---- wl_compositor ---------------------------------------------------------
+
+    static void bind_compositor(wl_client* client, void* data, uint32_t version, uint32_t id) {
+        wl_resource* resource = wl_resource_create(client, &wl_compositor_interface, version, id);
+        wl_resource_set_implementation(resource, &m_compositor_implementation, data, nullptr);
+    }
+
+    static void create_surface(wl_client* client, wl_resource* compositor, uint32_t id) {
+        Server& server = *static_cast<Server*>(wl_resource_get_user_data(compositor));
+
+        wl_resource* resource = wl_resource_create(client, &wl_surface_interface, wl_resource_get_version(compositor), id);
+        auto* surface = new Surface { .server = server, .resource = resource };
+        wl_resource_set_implementation(resource, &m_surface_implementation, surface, surface_destroyed);
+        server.m_surfaces.push_back(surface);
+    }
+
+    static void create_region(wl_client* client, wl_resource* compositor, uint32_t id) {
+        wl_resource* resource = wl_resource_create(client, &wl_region_interface, wl_resource_get_version(compositor), id);
+        wl_resource_set_implementation(resource, &m_region_implementation, nullptr, nullptr);
+    }
+
+    static void destroy_resource([[maybe_unused]] wl_client* client, wl_resource* resource) {
+        wl_resource_destroy(resource);
+    }
+
+    [[nodiscard]] static Surface* get_surface(wl_resource* resource) {
+        return static_cast<Surface*>(wl_resource_get_user_data(resource));
+    }
+
+    static void surface_destroyed(wl_resource* resource) {
+        Surface* surface = get_surface(resource);
+        std::erase(surface->server.m_surfaces, surface);
+
+        // role objects outlive their surface if the client is torn down out of order
+        if (surface->xdg_surface != nullptr)
+            wl_resource_set_user_data(surface->xdg_surface, nullptr);
+        if (surface->role_resource != nullptr)
+            wl_resource_set_user_data(surface->role_resource, nullptr);
+        if (surface->fractional_scale != nullptr)
+            wl_resource_set_user_data(surface->fractional_scale, nullptr);
+
+        for (wl_resource* callback : surface->pending_frames)
+            wl_resource_set_user_data(callback, nullptr);
+        for (wl_resource* callback : surface->frames)
+            wl_resource_set_user_data(callback, nullptr);
+
+        surface->pending_buffer.clear();
+        delete surface;
+    }
+
+    static void surface_attach([[maybe_unused]] wl_client* client, wl_resource* resource, wl_resource* buffer, [[maybe_unused]] int32_t x, [[maybe_unused]] int32_t y) {
+        get_surface(resource)->pending_buffer.set(buffer);
+    }
+
+    static void surface_frame(wl_client* client, wl_resource* resource, uint32_t id) {
+        Surface* surface = get_surface(resource);
+
+        wl_resource* callback = wl_resource_create(client, &wl_callback_interface, 1, id);
+        wl_resource_set_implementation(callback, nullptr, surface, [](wl_resource* callback) {
+            Surface* surface = get_surface(callback);
+            if (surface == nullptr) return;
+            std::erase(surface->pending_frames, callback);
+            std::erase(surface->frames, callback);
+        });
+        surface->pending_frames.push_back(callback);
+    }
+
+    static void surface_commit([[maybe_unused]] wl_client* client, wl_resource* resource) {
+        Surface& surface = *get_surface(resource);
+        Server& server = surface.server;
+        ++server.m_stats.commits;
+        surface.committed = true;
+
+        // the first commit after a role is assigned asks for the initial configure, which a replay sends for windows
+        if (!surface.configure_sent && !(server.replaying() && surface.window))
+            server.send_configure(surface, server.m_options.width, server.m_options.height);
+
+        if (surface.pending_buffer.attached) {
+            if (surface.pending_buffer.resource != nullptr) {
+                // nothing is ever read from it, so it can go straight back to the client
+                wl_buffer_send_release(surface.pending_buffer.resource);
+                ++server.m_stats.buffers;
+            }
+            surface.pending_buffer.clear();
+        }
+
+        surface.frames.insert(surface.frames.end(), surface.pending_frames.begin(), surface.pending_frames.end());
+        surface.pending_frames.clear();
+
+        if (server.m_options.frame_interval.count() == 0 && !server.replaying())
+            server.present(std::array { &surface });
+    }
+
+    // ---- wl_subcompositor ------------------------------------------------------
+
+    static void bind_subcompositor(wl_client* client, void* data, uint32_t version, uint32_t id) {
+        wl_resource* resource = wl_resource_create(client, &wl_subcompositor_interface, version, id);
+        wl_resource_set_implementation(resource, &m_subcompositor_implementation, data, nullptr);
+    }
+
+    static void get_subsurface(wl_client* client, wl_resource* subcompositor, uint32_t id, wl_resource* surface, [[maybe_unused]] wl_resource* parent) {
+        get_surface(surface)->role = Role::Subsurface;
+
+        wl_resource* resource = wl_resource_create(client, &wl_subsurface_interface, wl_resource_get_version(subcompositor), id);
+        wl_resource_set_implementation(resource, &m_subsurface_implementation, nullptr, nullptr);
+    }
+
+    // ---- wl_output -------------------------------------------------------------
+
+    uint32_t create_output(const Output& mode) {
+        auto id = static_cast<uint32_t>(m_outputs.size());
+        auto& output = m_outputs.emplace_back(std::make_unique<OutputGlobal>(OutputGlobal { .server = *this, .id = id, .mode = mode }));
+        output->global = wl_global_create(m_display, &wl_output_interface, 4, output.get(), bind_output);
+        return id;
+    }
+
+    [[nodiscard]] static bool shown_on(const Surface& surface, const OutputGlobal& output) {
+        return surface.output == nullptr || surface.output == &output;
+    }
+
+    void enter_outputs(Surface& surface) {
+        surface.entered = true;
+
+        for (const auto& output : m_outputs) {
+            if (output->removed || !shown_on(surface, *output)) continue;
+
+            for (wl_resource* resource : output->resources) {
+                if (wl_resource_get_client(resource) == wl_resource_get_client(surface.resource))
+                    wl_surface_send_enter(surface.resource, resource);
+            }
+        }
+    }
+
+    static void bind_output(wl_client* client, void* data, uint32_t version, uint32_t id) {
+        OutputGlobal& output = *static_cast<OutputGlobal*>(data);
+        const Output& mode = output.mode;
+
+        wl_resource* resource = wl_resource_create(client, &wl_output_interface, version, id);
+        wl_resource_set_implementation(resource, &m_output_implementation, &output, [](wl_resource* resource) {
+            auto& output = *static_cast<OutputGlobal*>(wl_resource_get_user_data(resource));
+            std::erase(output.resources, resource);
+        });
+        output.resources.push_back(resource);
+
+        wl_output_send_geometry(resource, 0, 0, 0, 0, WL_OUTPUT_SUBPIXEL_UNKNOWN, "mock", "mock", WL_OUTPUT_TRANSFORM_NORMAL);
+        wl_output_send_mode(resource, WL_OUTPUT_MODE_CURRENT | WL_OUTPUT_MODE_PREFERRED, mode.width, mode.height, mode.refresh);
+
+        if (version >= WL_OUTPUT_SCALE_SINCE_VERSION)
+            wl_output_send_scale(resource, mode.scale);
+
+        if (version >= WL_OUTPUT_NAME_SINCE_VERSION) {
+            wl_output_send_name(resource, ("MOCK-" + std::to_string(output.id + 1)).c_str());
+            wl_output_send_description(resource, "mock output");
+        }
+
+        if (version >= WL_OUTPUT_DONE_SINCE_VERSION)
+            wl_output_send_done(resource);
+
+        // surfaces that are already shown on it
+        for (Surface* surface : output.server.m_surfaces) {
+            if (surface->entered && shown_on(*surface, output) && wl_resource_get_client(surface->resource) == client)
+                wl_surface_send_enter(surface->resource, resource);
+        }
+    }
+
+    // ---- wl_seat ---------------------------------------------------------------
+
+    static void bind_seat(wl_client* client, void* data, uint32_t version, uint32_t id) {
+        wl_resource* resource = wl_resource_create(client, &wl_seat_interface, version, id);
+        wl_resource_set_implementation(resource, &m_seat_implementation, data, nullptr);
+
+        wl_seat_send_capabilities(resource, WL_SEAT_CAPABILITY_KEYBOARD);
+        if (version >= WL_SEAT_NAME_SINCE_VERSION)
+            wl_seat_send_name(resource, "mock");
+    }
+
+    static void get_keyboard(wl_client* client, wl_resource* seat, uint32_t id) {
+        Server& server = *static_cast<Server*>(wl_resource_get_user_data(seat));
+
+        wl_resource* resource = wl_resource_create(client, &wl_keyboard_interface, wl_resource_get_version(seat), id);
+        wl_resource_set_implementation(resource, &m_keyboard_implementation, &server, [](wl_resource* resource) {
+            Server& server = *static_cast<Server*>(wl_resource_get_user_data(resource));
+            std::erase(server.m_keyboards, resource);
+        });
+        server.m_keyboards.push_back(resource);
+
+        // keys are sent as raw keycodes
+        int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        wl_keyboard_send_keymap(resource, WL_KEYBOARD_KEYMAP_FORMAT_NO_KEYMAP, fd, 0);
+        close(fd);
+    }
+
+    static void get_unsupported_device([[maybe_unused]] wl_client* client, wl_resource* seat, [[maybe_unused]] uint32_t id) {
+        wl_resource_post_error(seat, WL_SEAT_ERROR_MISSING_CAPABILITY, "the mock seat only has a keyboard");
+    }
+
+    // ---- xdg_wm_base -----------------------------------------------------------
+
+    static void bind_xdg_wm_base(wl_client* client, void* data, uint32_t version, uint32_t id) {
+        wl_resource* resource = wl_resource_create(client, &xdg_wm_base_interface, version, id);
+        wl_resource_set_implementation(resource, &m_xdg_wm_base_implementation, data, nullptr);
+    }
+
+    static void create_positioner(wl_client* client, wl_resource* xdg_wm_base, uint32_t id) {
+        wl_resource* resource = wl_resource_create(client, &xdg_positioner_interface, wl_resource_get_version(xdg_wm_base), id);
+        wl_resource_set_implementation(resource, &m_xdg_positioner_implementation, new Positioner, [](wl_resource* resource) {
+            delete static_cast<Positioner*>(wl_resource_get_user_data(resource));
+        });
+    }
+
+    static void get_xdg_surface(wl_client* client, wl_resource* xdg_wm_base, uint32_t id, wl_resource* surface_resource) {
+        Surface* surface = get_surface(surface_resource);
+
+        wl_resource* resource = wl_resource_create(client, &xdg_surface_interface, wl_resource_get_version(xdg_wm_base), id);
+        wl_resource_set_implementation(resource, &m_xdg_surface_implementation, surface, [](wl_resource* resource) {
+            if (Surface* surface = get_surface(resource))
+                surface->xdg_surface = nullptr;
+        });
+        surface->xdg_surface = resource;
+    }
+
+    static void positioner_set_size([[maybe_unused]] wl_client* client, wl_resource* resource, int32_t width, int32_t height) {
+        auto& positioner = *static_cast<Positioner*>(wl_resource_get_user_data(resource));
+        positioner.width = width;
+        positioner.height = height;
+    }
+
+    static void role_destroyed(wl_resource* resource) {
+        Surface* surface = get_surface(resource);
+        if (surface == nullptr) return;
+
+        // the surface may get a new role object of the same kind, which starts over with a configure
+        surface->role_resource = nullptr;
+        surface->configure_sent = false;
+    }
+
+    static void get_toplevel(wl_client* client, wl_resource* xdg_surface, uint32_t id) {
+        Surface* surface = get_surface(xdg_surface);
+
+        wl_resource* resource = wl_resource_create(client, &xdg_toplevel_interface, wl_resource_get_version(xdg_surface), id);
+        wl_resource_set_implementation(resource, &m_xdg_toplevel_implementation, surface, role_destroyed);
+        surface->role = Role::Toplevel;
+        surface->role_resource = resource;
+        surface->window = surface->server.m_next_window++;
+    }
+
+    static void get_popup(wl_client* client, wl_resource* xdg_surface, uint32_t id, [[maybe_unused]] wl_resource* parent, wl_resource* positioner_resource) {
+        Surface* surface = get_surface(xdg_surface);
+        const auto& positioner = *static_cast<Positioner*>(wl_resource_get_user_data(positioner_resource));
+
+        wl_resource* resource = wl_resource_create(client, &xdg_popup_interface, wl_resource_get_version(xdg_surface), id);
+        wl_resource_set_implementation(resource, &m_xdg_popup_implementation, surface, role_destroyed);
+        surface->role = Role::Popup;
+        surface->role_resource = resource;
+        surface->requested_width = positioner.width;
+        surface->requested_height = positioner.height;
+    }
+
+    static void ack_configure([[maybe_unused]] wl_client* client, wl_resource* resource, [[maybe_unused]] uint32_t serial) {
+        if (Surface* surface = get_surface(resource))
+            ++surface->server.m_stats.acks;
+    }
+
+    // ---- zwlr_layer_shell_v1 ---------------------------------------------------
+
+    static void bind_layer_shell(wl_client* client, void* data, uint32_t version, uint32_t id) {
+        wl_resource* resource = wl_resource_create(client, &zwlr_layer_shell_v1_interface, version, id);
+        wl_resource_set_implementation(resource, &m_layer_shell_implementation, data, nullptr);
+    }
+
+    static void get_layer_surface(wl_client* client, wl_resource* layer_shell, uint32_t id, wl_resource* surface_resource,
+                                  wl_resource* output, [[maybe_unused]] uint32_t layer, [[maybe_unused]] const char* name_space) {
+        Surface* surface = get_surface(surface_resource);
+
+        wl_resource* resource = wl_resource_create(client, &zwlr_layer_surface_v1_interface, wl_resource_get_version(layer_shell), id);
+        wl_resource_set_implementation(resource, &m_layer_surface_implementation, surface, role_destroyed);
+        surface->role = Role::Layer;
+        surface->role_resource = resource;
+        surface->output = output != nullptr ? static_cast<OutputGlobal*>(wl_resource_get_user_data(output)) : nullptr;
+        surface->window = surface->server.m_next_window++;
+    }
+
+    static void layer_surface_set_size([[maybe_unused]] wl_client* client, wl_resource* resource, uint32_t width, uint32_t height) {
+        if (Surface* surface = get_surface(resource)) {
+            surface->requested_width = width;
+            surface->requested_height = height;
+        }
+    }
+
+    // ---- wp_viewporter and wp_fractional_scale_manager_v1 -----------------------
+
+    // viewports are accepted and ignored, as nothing is ever shown
+    static void bind_viewporter(wl_client* client, void* data, uint32_t version, uint32_t id) {
+        wl_resource* resource = wl_resource_create(client, &wp_viewporter_interface, version, id);
+        wl_resource_set_implementation(resource, &m_viewporter_implementation, data, nullptr);
+    }
+
+    static void get_viewport(wl_client* client, wl_resource* viewporter, uint32_t id, [[maybe_unused]] wl_resource* surface) {
+        wl_resource* resource = wl_resource_create(client, &wp_viewport_interface, wl_resource_get_version(viewporter), id);
+        wl_resource_set_implementation(resource, &m_viewport_implementation, nullptr, nullptr);
+    }
+
+    static void bind_fractional_scale_manager(wl_client* client, void* data, uint32_t version, uint32_t id) {
+        wl_resource* resource = wl_resource_create(client, &wp_fractional_scale_manager_v1_interface, version, id);
+        wl_resource_set_implementation(resource, &m_fractional_scale_manager_implementation, data, nullptr);
+    }
+
+    static void get_fractional_scale(wl_client* client, wl_resource* manager, uint32_t id, wl_resource* surface_resource) {
+        Surface* surface = get_surface(surface_resource);
+
+        wl_resource* resource = wl_resource_create(client, &wp_fractional_scale_v1_interface, wl_resource_get_version(manager), id);
+        wl_resource_set_implementation(resource, &m_fractional_scale_implementation, surface, [](wl_resource* resource) {
+            if (Surface* surface = get_surface(resource))
+                surface->fractional_scale = nullptr;
+        });
+        surface->fractional_scale = resource;
+    }
+
+    // ---- implementations -------------------------------------------------------
+
+    static inline const struct wl_compositor_interface m_compositor_implementation {
+        .create_surface = create_surface,
+        .create_region  = create_region,
+    };
+
+    static inline const struct wl_surface_interface m_surface_implementation {
+        .destroy              = destroy_resource,
+        .attach               = surface_attach,
+        .damage               = util::DefaultConstructedFunction<decltype(wl_surface_interface::damage)>::value,
+        .frame                = surface_frame,
+        .set_opaque_region    = util::DefaultConstructedFunction<decltype(wl_surface_interface::set_opaque_region)>::value,
+        .set_input_region     = util::DefaultConstructedFunction<decltype(wl_surface_interface::set_input_region)>::value,
+        .commit               = surface_commit,
+        .set_buffer_transform = util::DefaultConstructedFunction<decltype(wl_surface_interface::set_buffer_transform)>::value,
+        .set_buffer_scale     = util::DefaultConstructedFunction<decltype(wl_surface_interface::set_buffer_scale)>::value,
+        .damage_buffer        = util::DefaultConstructedFunction<decltype(wl_surface_interface::damage_buffer)>::value,
+        .offset               = util::DefaultConstructedFunction<decltype(wl_surface_interface::offset)>::value,
+    };
+
+    static inline const struct wl_region_interface m_region_implementation {
+        .destroy  = destroy_resource,
+        .add      = util::DefaultConstructedFunction<decltype(wl_region_interface::add)>::value,
+        .subtract = util::DefaultConstructedFunction<decltype(wl_region_interface::subtract)>::value,
+    };
+
+    static inline const struct wl_subcompositor_interface m_subcompositor_implementation {
+        .destroy        = destroy_resource,
+        .get_subsurface = get_subsurface,
+    };
+
+    static inline const struct wl_subsurface_interface m_subsurface_implementation {
+        .destroy      = destroy_resource,
+        .set_position = util::DefaultConstructedFunction<decltype(wl_subsurface_interface::set_position)>::value,
+        .place_above  = util::DefaultConstructedFunction<decltype(wl_subsurface_interface::place_above)>::value,
+        .place_below  = util::DefaultConstructedFunction<decltype(wl_subsurface_interface::place_below)>::value,
+        .set_sync     = util::DefaultConstructedFunction<decltype(wl_subsurface_interface::set_sync)>::value,
+        .set_desync   = util::DefaultConstructedFunction<decltype(wl_subsurface_interface::set_desync)>::value,
+    };
+
+    static inline const struct wl_output_interface m_output_implementation {
+        .release = destroy_resource,
+    };
+
+    static inline const struct wl_seat_interface m_seat_implementation {
+        .get_pointer  = get_unsupported_device,
+        .get_keyboard = get_keyboard,
+        .get_touch    = get_unsupported_device,
+        .release      = destroy_resource,
+    };
+
+    static inline const struct wl_keyboard_interface m_keyboard_implementation {
+        .release = destroy_resource,
+    };
+
+    static inline const struct xdg_wm_base_interface m_xdg_wm_base_implementation {
+        .destroy           = destroy_resource,
+        .create_positioner = create_positioner,
+        .get_xdg_surface   = get_xdg_surface,
+        .pong              = util::DefaultConstructedFunction<decltype(xdg_wm_base_interface::pong)>::value,
+    };
+
+    static inline const struct xdg_positioner_interface m_xdg_positioner_implementation {
+        .destroy                   = destroy_resource,
+        .set_size                  = positioner_set_size,
+        .set_anchor_rect           = util::DefaultConstructedFunction<decltype(xdg_positioner_interface::set_anchor_rect)>::value,
+        .set_anchor                = util::DefaultConstructedFunction<decltype(xdg_positioner_interface::set_anchor)>::value,
+        .set_gravity               = util::DefaultConstructedFunction<decltype(xdg_positioner_interface::set_gravity)>::value,
+        .set_constraint_adjustment = util::DefaultConstructedFunction<decltype(xdg_positioner_interface::set_constraint_adjustment)>::value,
+        .set_offset                = util::DefaultConstructedFunction<decltype(xdg_positioner_interface::set_offset)>::value,
+        .set_reactive              = util::DefaultConstructedFunction<decltype(xdg_positioner_interface::set_reactive)>::value,
+        .set_parent_size           = util::DefaultConstructedFunction<decltype(xdg_positioner_interface::set_parent_size)>::value,
+        .set_parent_configure      = util::DefaultConstructedFunction<decltype(xdg_positioner_interface::set_parent_configure)>::value,
+    };
+
+    static inline const struct xdg_surface_interface m_xdg_surface_implementation {
+        .destroy             = destroy_resource,
+        .get_toplevel        = get_toplevel,
+        .get_popup           = get_popup,
+        .set_window_geometry = util::DefaultConstructedFunction<decltype(xdg_surface_interface::set_window_geometry)>::value,
+        .ack_configure       = ack_configure,
+    };
+
+    static inline const struct xdg_toplevel_interface m_xdg_toplevel_implementation {
+        .destroy          = destroy_resource,
+        .set_parent       = util::DefaultConstructedFunction<decltype(xdg_toplevel_interface::set_parent)>::value,
+        .set_title        = util::DefaultConstructedFunction<decltype(xdg_toplevel_interface::set_title)>::value,
+        .set_app_id       = util::DefaultConstructedFunction<decltype(xdg_toplevel_interface::set_app_id)>::value,
+        .show_window_menu = util::DefaultConstructedFunction<decltype(xdg_toplevel_interface::show_window_menu)>::value,
+        .move             = util::DefaultConstructedFunction<decltype(xdg_toplevel_interface::move)>::value,
+        .resize           = util::DefaultConstructedFunction<decltype(xdg_toplevel_interface::resize)>::value,
+        .set_max_size     = util::DefaultConstructedFunction<decltype(xdg_toplevel_interface::set_max_size)>::value,
+        .set_min_size     = util::DefaultConstructedFunction<decltype(xdg_toplevel_interface::set_min_size)>::value,
+        .set_maximized    = util::DefaultConstructedFunction<decltype(xdg_toplevel_interface::set_maximized)>::value,
+        .unset_maximized  = util::DefaultConstructedFunction<decltype(xdg_toplevel_interface::unset_maximized)>::value,
+        .set_fullscreen   = util::DefaultConstructedFunction<decltype(xdg_toplevel_interface::set_fullscreen)>::value,
+        .unset_fullscreen = util::DefaultConstructedFunction<decltype(xdg_toplevel_interface::unset_fullscreen)>::value,
+        .set_minimized    = util::DefaultConstructedFunction<decltype(xdg_toplevel_interface::set_minimized)>::value,
+    };
+
+    static inline const struct xdg_popup_interface m_xdg_popup_implementation {
+        .destroy    = destroy_resource,
+        .grab       = util::DefaultConstructedFunction<decltype(xdg_popup_interface::grab)>::value,
+        .reposition = util::DefaultConstructedFunction<decltype(xdg_popup_interface::reposition)>::value,
+    };
+
+    static inline const struct zwlr_layer_shell_v1_interface m_layer_shell_implementation {
+        .get_layer_surface = get_layer_surface,
+        .destroy           = destroy_resource,
+    };
+
+    static inline const struct zwlr_layer_surface_v1_interface m_layer_surface_implementation {
+        .set_size                   = layer_surface_set_size,
+        .set_anchor                 = util::DefaultConstructedFunction<decltype(zwlr_layer_surface_v1_interface::set_anchor)>::value,
+        .set_exclusive_zone         = util::DefaultConstructedFunction<decltype(zwlr_layer_surface_v1_interface::set_exclusive_zone)>::value,
+        .set_margin                 = util::DefaultConstructedFunction<decltype(zwlr_layer_surface_v1_interface::set_margin)>::value,
+        .set_keyboard_interactivity = util::DefaultConstructedFunction<decltype(zwlr_layer_surface_v1_interface::set_keyboard_interactivity)>::value,
+        .get_popup                  = util::DefaultConstructedFunction<decltype(zwlr_layer_surface_v1_interface::get_popup)>::value,
+        .ack_configure              = ack_configure,
+        .destroy                    = destroy_resource,
+        .set_layer                  = util::DefaultConstructedFunction<decltype(zwlr_layer_surface_v1_interface::set_layer)>::value,
+        .set_exclusive_edge         = util::DefaultConstructedFunction<decltype(zwlr_layer_surface_v1_interface::set_exclusive_edge)>::value,
+    };
+
+    static inline const struct wp_viewporter_interface m_viewporter_implementation {
+        .destroy      = destroy_resource,
+        .get_viewport = get_viewport,
+    };
+
+    static inline const struct wp_viewport_interface m_viewport_implementation {
+        .destroy         = destroy_resource,
+        .set_source      = util::DefaultConstructedFunction<decltype(wp_viewport_interface::set_source)>::value,
+        .set_destination = util::DefaultConstructedFunction<decltype(wp_viewport_interface::set_destination)>::value,
+    };
+
+    static inline const struct wp_fractional_scale_manager_v1_interface m_fractional_scale_manager_implementation {
+        .destroy              = destroy_resource,
+        .get_fractional_scale = get_fractional_scale,
+    };
+
+    static inline const struct wp_fractional_scale_v1_interface m_fractional_scale_implementation {
+        .destroy = destroy_resource,
+    };
+};
+
+Compositor::Compositor()
+    : Compositor(Options{})
+{ }
+
+Compositor::Compositor(Options options)
+    : m_server(std::make_unique<Server>(std::move(options)))
+{ }
+
+Compositor::~Compositor() = default;
+
+int Compositor::connect_client() {
+    return m_server->connect_client();
+}
+
+void Compositor::configure(int32_t width, int32_t height) {
+    m_server->configure(width, height);
+}
+
+uint32_t Compositor::add_output(Output output) {
+    return m_server->add_output(output);
+}
+
+void Compositor::remove_output(uint32_t id) {
+    m_server->remove_output(id);
+}
+
+Compositor::Stats Compositor::stats() const {
+    return m_server->stats();
+}
+
+} // namespace mock
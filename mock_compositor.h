@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "replay.h"
+
+namespace mock {
+
+// a minimal in-process compositor on libwayland-server, for benchmarking and testing clients
+// deterministically on a machine without a display. runs on its own thread and implements
+// wl_compositor, wl_subcompositor, wl_shm, wl_output, a wl_seat with a keyboard, xdg_wm_base,
+// zwlr_layer_shell_v1, wp_viewporter and wp_fractional_scale_manager_v1.
+// toplevels are shown on every output, layer surfaces on the one they asked for or every output.
+// buffers are released as soon as they are committed, and frame callbacks are either sent right
+// away or on a fixed interval, with timestamps from a virtual clock instead of a real display
+class Compositor {
+public:
+    // resizes every toplevel and layer surface once the given number of frames have been presented
+    struct ScriptedConfigure {
+        uint64_t frame = 0;
+        int32_t width = 0;
+        int32_t height = 0;
+    };
+
+    struct Output {
+        int32_t width = 1920;
+        int32_t height = 1080;
+        int32_t refresh = 60000; // in mHz
+        int32_t scale = 1;
+    };
+
+    struct Options {
+        // the output that is plugged in from the start, with the id 0
+        int32_t output_width = 1920;
+        int32_t output_height = 1080;
+        int32_t output_refresh = 60000; // in mHz
+        // size sent in the first configure of a toplevel, 0 lets the client pick
+        int32_t width = 0;
+        int32_t height = 0;
+        // time between frame callbacks, zero sends them as soon as the surface is committed
+        std::chrono::nanoseconds frame_interval{0};
+        // ordered by frame
+        std::vector<ScriptedConfigure> script{};
+        // a recorded session, replayed instead of configuring the toplevels and layer surfaces and sending
+        // their frame callbacks on its own. each frame is sent as soon as its window asked for one,
+        // so the replay runs as fast as the client renders. the windows are matched in the order they
+        // were created, events for windows the client never creates stall the replay
+        std::vector<replay::Event> replay{};
+    };
+
+    struct Stats {
+        uint64_t commits = 0;
+        uint64_t buffers = 0; // commits with a new buffer
+        uint64_t frames = 0;  // rounds of frame callbacks sent
+        uint64_t configures = 0;
+        uint64_t acks = 0;
+        uint64_t replayed = 0; // events of Options::replay sent
+        uint64_t surfaces = 0; // wl_surfaces that currently exist
+    };
+
+    Compositor();
+    explicit Compositor(Options options);
+    ~Compositor();
+
+    Compositor(const Compositor&) = delete;
+    Compositor& operator=(const Compositor&) = delete;
+
+    // one end of a new client connection, for WaylandConnection(int) or wl_display_connect_to_fd,
+    // which take ownership of it
+    [[nodiscard]] int connect_client();
+
+    // sends a configure with the given size to every toplevel and layer surface
+    void configure(int32_t width, int32_t height);
+
+    // plugs in another output, the surfaces shown on it enter it once the client binds it.
+    // returns an id for remove_output()
+    uint32_t add_output(Output output);
+
+    // unplugs an output, the surfaces shown on it leave it first
+    void remove_output(uint32_t id);
+
+    [[nodiscard]] Stats stats() const;
+
+private:
+    // keeps libwayland-server out of the clients that include this
+    class Server;
+    std::unique_ptr<Server> m_server;
+};
+
+} // namespace mock
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <gfx/gfx.h>
+
+namespace offscreen {
+
+// a gfx::Surface without a window system: an EGL context on mesa's surfaceless platform, or the
+// default display if that isn't available, rendering into a framebuffer object of the given size.
+// draw functions written for WaylandWindow run unchanged, as fast as the gpu allows
+class OffscreenSurface : public gfx::Surface {
+public:
+    using DrawFn = std::function<void(gfx::Renderer&)>;
+
+private:
+    EGLDisplay m_egl_display = EGL_NO_DISPLAY;
+    bool m_egl_initialized = false;
+    EGLContext m_egl_context = EGL_NO_CONTEXT;
+    // only without EGL_KHR_surfaceless_context, a 1x1 pbuffer to make the context current with
+    EGLSurface m_egl_surface = EGL_NO_SURFACE;
+
+    GLuint m_framebuffer = 0;
+    GLuint m_color_buffer = 0;
+    int m_width = 0;
+    int m_height = 0;
+
+    std::optional<gfx::Renderer> m_renderer;
+
+    // every OffscreenSurface in the process gets the same display, and eglTerminate would destroy the
+    // contexts of all of them, so only the last one to go terminates it
+    static inline std::mutex m_display_mutex;
+    static inline int m_display_users = 0;
+
+    // the same as WaylandConnection's, so draw functions see the same GL
+    static constexpr std::array m_egl_context_attribs {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 5,
+        EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+        EGL_NONE
+    };
+
+public:
+    OffscreenSurface(int width, int height) {
+        // the destructor doesn't run if this throws, and the display would never be terminated
+        try {
+            if (!init_egl())
+                throw std::runtime_error("failed to initialize EGL for offscreen rendering");
+
+            make_current();
+            glGenFramebuffers(1, &m_framebuffer);
+            glGenRenderbuffers(1, &m_color_buffer);
+            resize(width, height);
+
+            m_renderer.emplace(*this);
+        } catch (...) {
+            release();
+            throw;
+        }
+    }
+
+    OffscreenSurface(const OffscreenSurface&) = delete;
+    OffscreenSurface& operator=(const OffscreenSurface&) = delete;
+
+    ~OffscreenSurface() {
+        release();
+    }
+
+    [[nodiscard]] int get_width() const override {
+        return m_width;
+    }
+
+    [[nodiscard]] int get_height() const override {
+        return m_height;
+    }
+
+    // reallocates the framebuffer, its contents are undefined until the next draw
+    void resize(int width, int height) {
+        if (width <= 0 || height <= 0)
+            throw std::invalid_argument("offscreen surfaces need a size of at least 1x1");
+
+        m_width = width;
+        m_height = height;
+
+        make_current();
+        glBindRenderbuffer(GL_RENDERBUFFER, m_color_buffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_color_buffer);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            throw std::runtime_error("offscreen framebuffer is incomplete");
+    }
+
+    // only submits the commands, finish() or read_pixels() wait for them
+    void draw(const DrawFn& draw_fn) {
+        make_current();
+        glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+        glViewport(0, 0, m_width, m_height);
+        draw_fn(*m_renderer);
+        glFlush();
+    }
+
+    void finish() {
+        make_current();
+        glFinish();
+    }
+
+    // RGBA8, bottom row first as GL stores it, waits for rendering to finish
+    [[nodiscard]] std::vector<uint8_t> read_pixels() {
+        std::vector<uint8_t> pixels(static_cast<size_t>(m_width) * m_height * 4);
+
+        make_current();
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        return pixels;
+    }
+
+    // for GL calls outside of draw(), e.g. to read the framebuffer asynchronously
+    void make_current() {
+        eglMakeCurrent(m_egl_display, m_egl_surface, m_egl_surface, m_egl_context);
+    }
+
+    [[nodiscard]] GLuint framebuffer() const {
+        return m_framebuffer;
+    }
+
+private:
+    // whatever was created so far, also after a constructor that failed halfway
+    void release() {
+        if (m_egl_context != EGL_NO_CONTEXT) {
+            make_current();
+            m_renderer.reset();
+            if (m_framebuffer != 0) glDeleteFramebuffers(1, &m_framebuffer);
+            if (m_color_buffer != 0) glDeleteRenderbuffers(1, &m_color_buffer);
+            eglMakeCurrent(m_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(m_egl_display, m_egl_context);
+        }
+
+        if (m_egl_surface != EGL_NO_SURFACE) eglDestroySurface(m_egl_display, m_egl_surface);
+
+        if (m_egl_initialized) {
+            std::scoped_lock lock(m_display_mutex);
+            if (--m_display_users == 0)
+                eglTerminate(m_egl_display);
+        }
+    }
+
+    [[nodiscard]] bool init_egl() {
+        // nullptr without EGL_EXT_client_extensions
+        const char* client_extensions_string = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        std::string_view client_extensions = client_extensions_string != nullptr ? client_extensions_string : "";
+
+        // the surfaceless platform needs neither a display server nor a gpu device node to be accessible
+        if (client_extensions.contains("EGL_MESA_platform_surfaceless")) {
+            auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+            if (get_platform_display != nullptr)
+                m_egl_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        }
+        if (m_egl_display == EGL_NO_DISPLAY)
+            m_egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (m_egl_display == EGL_NO_DISPLAY) return false;
+
+        {
+            std::scoped_lock lock(m_display_mutex);
+            if (eglInitialize(m_egl_display, nullptr, nullptr) != EGL_TRUE) return false;
+            m_egl_initialized = true;
+            ++m_display_users;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API)) return false;
+
+        constexpr std::array config_attribs {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RED_SIZE,   8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE,  8,
+            EGL_ALPHA_SIZE, 8,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+
+        EGLConfig config;
+        EGLint n = 0;
+        if (eglChooseConfig(m_egl_display, config_attribs.data(), &config, 1, &n) != EGL_TRUE || n == 0) return false;
+
+        m_egl_context = eglCreateContext(m_egl_display, config, EGL_NO_CONTEXT, m_egl_context_attribs.data());
+        if (m_egl_context == EGL_NO_CONTEXT) return false;
+
+        std::string_view extensions = eglQueryString(m_egl_display, EGL_EXTENSIONS);
+        if (!extensions.contains("EGL_KHR_surfaceless_context")) {
+            constexpr std::array pbuffer_attribs { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+            m_egl_surface = eglCreatePbufferSurface(m_egl_display, config, pbuffer_attribs.data());
+            if (m_egl_surface == EGL_NO_SURFACE) return false;
+        }
+
+        return true;
+    }
+};
+
+} // namespace offscreen
@@ -0,0 +1,384 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include <wayland-client-core.h>
+
+#ifdef WAYLAND_PROTOCOL_STATS
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <type_traits>
+
+#include <ffi.h>
+#endif
+
+#include "frame_profiler.h"
+
+// counts the requests and events of every wayland message per interface and opcode, with the bytes
+// and file descriptors they put on the wire. only compiled in with WAYLAND_PROTOCOL_STATS defined
+// (cmake -DPROTOCOL_STATS=ON), otherwise snapshot() is empty and messages aren't touched at all.
+//
+// requests are counted by redirecting wl_proxy_marshal_flags, which every generated request calls, and events
+// by installing listeners through a dispatcher. both are macros, so this has to be included before any
+// protocol header. messages sent and received by EGL on its own proxies, e.g. the commit of eglSwapBuffers,
+// don't go through them and aren't counted
+namespace util::protocol_stats {
+
+enum class Direction { Request, Event };
+
+struct Entry {
+    std::string_view interface;
+    std::string_view message;
+    Direction direction = Direction::Request;
+    uint64_t count = 0;
+    uint64_t bytes = 0; // including the 8 byte header
+    uint64_t fds = 0;
+};
+
+struct Snapshot {
+    std::chrono::nanoseconds time{0};
+    // sorted by interface, direction and message
+    std::vector<Entry> entries{};
+};
+
+// the size on the wire of a message with the given signature, with strings and arrays padded to 32 bits
+[[nodiscard]] constexpr size_t wire_size(std::string_view signature, const wl_argument* args, size_t* fds = nullptr) {
+    auto padded = [](size_t size) { return (size + 3) & ~size_t{3}; };
+
+    size_t size = 8;
+    size_t index = 0;
+    for (char type : signature) {
+        switch (type) {
+        case 'i': case 'u': case 'f': case 'o': case 'n':
+            size += 4;
+            break;
+        case 's':
+            size += 4 + (args[index].s != nullptr ? padded(std::char_traits<char>::length(args[index].s) + 1) : 0);
+            break;
+        case 'a':
+            size += 4 + (args[index].a != nullptr ? padded(args[index].a->size) : 0);
+            break;
+        case 'h':
+            // sent as ancillary data
+            if (fds != nullptr) ++*fds;
+            break;
+        default:
+            // '?' and the version the argument was added in
+            continue;
+        }
+        ++index;
+    }
+    return size;
+}
+
+consteval void test_wire_size() {
+    static_assert(wire_size("", nullptr) == 8);
+
+    static_assert([] {
+        // wl_surface.damage_buffer
+        std::array<wl_argument, 4> args{};
+        return wire_size("iiii", args.data()) == 24;
+    }());
+
+    static_assert([] {
+        // wl_registry.bind, versions in the signature don't count as arguments
+        std::array<wl_argument, 4> args{};
+        args[1].s = "wl_compositor";
+        return wire_size("usun", args.data()) == 8 + 4 + 4 + 16 + 4 + 4;
+    }());
+
+    static_assert([] {
+        // wl_keyboard.keymap, the fd isn't part of the message
+        std::array<wl_argument, 3> args{};
+        size_t fds = 0;
+        return wire_size("uhu", args.data(), &fds) == 16 && fds == 1;
+    }());
+
+    static_assert([] {
+        // nullable string
+        std::array<wl_argument, 1> args{};
+        args[0].s = nullptr;
+        return wire_size("2?s", args.data()) == 12;
+    }());
+}
+
+#ifdef WAYLAND_PROTOCOL_STATS
+
+inline constexpr bool enabled = true;
+
+// declared by wayland-client-protocol.h, which can only be included after the macros below
+extern "C" const wl_interface wl_display_interface;
+
+namespace detail {
+
+// a hash table of slots that are never removed, keyed by the address of static protocol data. every message
+// looks up its slot without locking, the mutex is only taken the first time a key is seen
+template <typename Value, size_t capacity>
+class SlotTable {
+    static_assert(std::has_single_bit(capacity));
+
+public:
+    // nullptr if the key has no slot yet
+    [[nodiscard]] Value* find(const void* key) {
+        for (size_t i = 0, index = hash(key); i < capacity; ++i, index = (index + 1) % capacity) {
+            const void* slot_key = m_slots[index].key.load(std::memory_order_acquire);
+            if (slot_key == key)
+                return &m_slots[index].value;
+            if (slot_key == nullptr)
+                return nullptr;
+        }
+        return nullptr;
+    }
+
+    // init(value) is called once, before the slot can be found. nullptr if the table is full
+    template <typename Init>
+    Value* find_or_insert(const void* key, Init&& init) {
+        for (size_t i = 0, index = hash(key); i < capacity; ++i, index = (index + 1) % capacity) {
+            Slot& slot = m_slots[index];
+            const void* slot_key = slot.key.load(std::memory_order_acquire);
+            if (slot_key == nullptr) {
+                std::lock_guard lock(m_mutex);
+                slot_key = slot.key.load(std::memory_order_relaxed);
+                if (slot_key == nullptr) {
+                    init(slot.value);
+                    slot.key.store(key, std::memory_order_release);
+                    return &slot.value;
+                }
+            }
+            // taken in the meantime, maybe by this key
+            if (slot_key == key)
+                return &slot.value;
+        }
+        return nullptr;
+    }
+
+    template <typename Fn>
+    void for_each(Fn&& fn) {
+        for (Slot& slot : m_slots) {
+            if (const void* key = slot.key.load(std::memory_order_acquire))
+                fn(key, slot.value);
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<const void*> key = nullptr;
+        Value value{};
+    };
+
+    static size_t hash(const void* key) {
+        // fibonacci hashing, the low bits of addresses are mostly alignment
+        return (reinterpret_cast<uintptr_t>(key) * 0x9e3779b97f4a7c15ull) >> (64 - std::countr_zero(capacity));
+    }
+
+    std::mutex m_mutex;
+    std::array<Slot, capacity> m_slots{};
+};
+
+struct Counter {
+    std::string_view interface;
+    Direction direction = Direction::Request;
+    std::atomic<uint64_t> count = 0;
+    std::atomic<uint64_t> bytes = 0;
+    std::atomic<uint64_t> fds = 0;
+};
+
+struct State {
+    // every message is its own wl_message, for every interface, so they identify interface and opcode.
+    // all the protocols this client uses together have a few hundred
+    SlotTable<Counter, 1024> counters;
+    // the interface of every proxy created so far, by the address of its name, which is what
+    // wl_proxy_get_class returns, as wl_proxy has no getter for the interface itself
+    SlotTable<const wl_interface*, 256> interfaces;
+
+    State() {
+        interfaces.find_or_insert(wl_display_interface.name, [](const wl_interface*& value) { value = &wl_display_interface; });
+    }
+};
+
+inline State& state() {
+    static State state;
+    return state;
+}
+
+inline void count(std::string_view interface, const wl_message* message, Direction direction, const wl_argument* args) {
+    size_t fds = 0;
+    size_t bytes = wire_size(message->signature, args, &fds);
+
+    Counter* counter = state().counters.find_or_insert(message, [&](Counter& counter) {
+        counter.interface = interface;
+        counter.direction = direction;
+    });
+    // more messages than the table holds, which no set of protocols comes close to
+    if (counter == nullptr)
+        return;
+    counter->count.fetch_add(1, std::memory_order_relaxed);
+    counter->bytes.fetch_add(bytes, std::memory_order_relaxed);
+    counter->fds.fetch_add(fds, std::memory_order_relaxed);
+}
+
+// the argument of the marshalled request, only as far as its size is concerned
+template <typename T>
+wl_argument to_argument(T value) {
+    wl_argument argument{};
+    if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*>)
+        argument.s = value;
+    else if constexpr (std::is_same_v<T, wl_array*>)
+        argument.a = value;
+    else if constexpr (std::is_pointer_v<T>)
+        argument.o = reinterpret_cast<wl_object*>(value);
+    else if constexpr (std::is_null_pointer_v<T>)
+        argument.o = nullptr;
+    else
+        argument.u = static_cast<uint32_t>(value);
+    return argument;
+}
+
+// calls a listener function the way libwayland does, which also goes through libffi
+inline void invoke(void (*function)(void), void* data, wl_proxy* proxy, std::string_view signature, wl_argument* args) {
+    // WL_CLOSURE_MAX_ARGS, plus the user data and the proxy
+    constexpr size_t max_args = 20 + 2;
+    std::array<ffi_type*, max_args> types;
+    std::array<void*, max_args> values;
+
+    types[0] = &ffi_type_pointer;
+    values[0] = &data;
+    types[1] = &ffi_type_pointer;
+    values[1] = &proxy;
+
+    size_t count = 2;
+    for (char type : signature) {
+        wl_argument& arg = args[count - 2];
+        switch (type) {
+        case 'i': types[count] = &ffi_type_sint32; values[count] = &arg.i; break;
+        case 'u': types[count] = &ffi_type_uint32; values[count] = &arg.u; break;
+        case 'f': types[count] = &ffi_type_sint32; values[count] = &arg.f; break;
+        case 'h': types[count] = &ffi_type_sint32; values[count] = &arg.h; break;
+        case 's': types[count] = &ffi_type_pointer; values[count] = &arg.s; break;
+        case 'a': types[count] = &ffi_type_pointer; values[count] = &arg.a; break;
+        // new objects of events are created before dispatching, both are proxies
+        case 'o': case 'n': types[count] = &ffi_type_pointer; values[count] = &arg.o; break;
+        default: continue;
+        }
+        ++count;
+    }
+
+    ffi_cif cif;
+    ffi_prep_cif(&cif, FFI_DEFAULT_ABI, count, &ffi_type_void, types.data());
+    ffi_call(&cif, function, nullptr, values.data());
+}
+
+inline int dispatch_event(const void* implementation, void* target, uint32_t opcode, const wl_message* message, wl_argument* args) {
+    auto* proxy = static_cast<wl_proxy*>(target);
+    count(wl_proxy_get_class(proxy), message, Direction::Event, args);
+
+    // listeners are arrays of function pointers, in the order of the events
+    auto function = static_cast<void (* const*)(void)>(implementation)[opcode];
+    if (function != nullptr)
+        invoke(function, wl_proxy_get_user_data(proxy), proxy, message->signature, args);
+    return 0;
+}
+
+} // namespace detail
+
+// stands in for wl_proxy_marshal_flags, counts the request before it's sent and possibly destroys the proxy
+template <typename... Args>
+wl_proxy* marshal_flags(wl_proxy* proxy, uint32_t opcode, const wl_interface* interface, uint32_t version, uint32_t flags, Args... args) {
+    detail::State& state = detail::state();
+    // constructors and wl_registry.bind pass the interface of the new object
+    if (interface != nullptr)
+        state.interfaces.find_or_insert(interface->name, [&](const wl_interface*& value) { value = interface; });
+
+    const wl_interface* const* known = state.interfaces.find(wl_proxy_get_class(proxy));
+    const wl_interface* proxy_interface = known != nullptr ? *known : nullptr;
+
+    // only objects created by events are unknown, and their requests aren't counted
+    if (proxy_interface != nullptr && opcode < static_cast<uint32_t>(proxy_interface->method_count)) {
+        std::array<wl_argument, sizeof...(Args) + 1> arguments { detail::to_argument(args)... };
+        detail::count(proxy_interface->name, &proxy_interface->methods[opcode], Direction::Request, arguments.data());
+    }
+
+    return (wl_proxy_marshal_flags)(proxy, opcode, interface, version, flags, args...);
+}
+
+// stands in for wl_proxy_add_listener, the listener is called by the dispatcher after counting the event
+inline int add_listener(wl_proxy* proxy, void (**implementation)(void), void* data) {
+    return wl_proxy_add_dispatcher(proxy, detail::dispatch_event, implementation, data);
+}
+
+[[nodiscard]] inline Snapshot snapshot() {
+    detail::State& state = detail::state();
+    Snapshot snapshot { .time = monotonic_now() };
+
+    state.counters.for_each([&](const void* key, const detail::Counter& counter) {
+        auto* message = static_cast<const wl_message*>(key);
+        snapshot.entries.push_back({ counter.interface, message->name, counter.direction, counter.count.load(std::memory_order_relaxed),
+            counter.bytes.load(std::memory_order_relaxed), counter.fds.load(std::memory_order_relaxed) });
+    });
+
+    std::ranges::sort(snapshot.entries, {}, [](const Entry& entry) { return std::tuple(entry.interface, entry.direction, entry.message); });
+    return snapshot;
+}
+
+#else
+
+inline constexpr bool enabled = false;
+
+[[nodiscard]] inline Snapshot snapshot() {
+    return {};
+}
+
+#endif
+
+// a table of the messages in current, with rates and file descriptors over the time since previous, e.g. the last report
+[[nodiscard]] inline std::string format(const Snapshot& current, const Snapshot& previous) {
+    double seconds = std::chrono::duration<double>(current.time - previous.time).count();
+    auto rate = [&](uint64_t value) { return seconds > 0.0 ? value / seconds : 0.0; };
+
+    std::string table = std::format("{:<48} {:>10} {:>10} {:>12} {:>8}\n", "message", "count", "per s", "bytes per s", "fds");
+    Entry total;
+    uint64_t total_count = 0;
+
+    for (const Entry& entry : current.entries) {
+        auto it = std::ranges::find_if(previous.entries, [&](const Entry& other) {
+            return other.interface == entry.interface && other.message == entry.message && other.direction == entry.direction;
+        });
+        uint64_t count = entry.count - (it != previous.entries.end() ? it->count : 0);
+        uint64_t bytes = entry.bytes - (it != previous.entries.end() ? it->bytes : 0);
+        uint64_t fds = entry.fds - (it != previous.entries.end() ? it->fds : 0);
+
+        // events are marked, requests are what the client calls
+        std::string name = std::format("{}{}.{}", entry.direction == Direction::Event ? "-> " : "", entry.interface, entry.message);
+        table += std::format("{:<48} {:>10} {:>10.1f} {:>12.0f} {:>8}\n", name, entry.count, rate(count), rate(bytes), fds);
+
+        total_count += entry.count;
+        total.count += count;
+        total.bytes += bytes;
+        total.fds += fds;
+    }
+
+    table += std::format("{:<48} {:>10} {:>10.1f} {:>12.0f} {:>8}\n", "total", total_count, rate(total.count), rate(total.bytes), total.fds);
+    return table;
+}
+
+} // namespace util::protocol_stats
+
+#ifdef WAYLAND_PROTOCOL_STATS
+
+#ifdef WAYLAND_CLIENT_PROTOCOL_H
+#error "protocol_stats.h has to be included before the protocol headers, or their messages aren't counted"
+#endif
+
+#define wl_proxy_marshal_flags(...) ::util::protocol_stats::marshal_flags(__VA_ARGS__)
+#define wl_proxy_add_listener(...) ::util::protocol_stats::add_listener(__VA_ARGS__)
+
+#endif
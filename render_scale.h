@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+namespace util {
+
+// factor the render resolution is multiplied by before the compositor scales the
+// buffer back up through wp_viewporter. either fixed, or adjusted from frame times.
+class RenderScale {
+public:
+    struct Dynamic {
+        // frame time we try to stay under
+        std::chrono::nanoseconds budget;
+        float min = 0.5f;
+        float max = 1.0f;
+        float step = 0.1f;
+        // resolution is only raised again when frames take less than this fraction of the budget
+        float headroom = 0.7f;
+        // frames to wait after a change, so the average can settle and buffers aren't reallocated constantly
+        int cooldown = 30;
+    };
+
+private:
+    float m_scale = 1.0f;
+    bool m_dynamic = false;
+    Dynamic m_config{};
+    // exponential moving average of the frame time in nanoseconds
+    double m_average = 0.0;
+    int m_frames_since_change = 0;
+
+public:
+    constexpr RenderScale() = default;
+
+    [[nodiscard]] static constexpr RenderScale fixed(float scale) {
+        RenderScale render_scale;
+        render_scale.m_scale = scale;
+        return render_scale;
+    }
+
+    [[nodiscard]] static constexpr RenderScale dynamic(Dynamic config) {
+        RenderScale render_scale;
+        render_scale.m_scale = config.max;
+        render_scale.m_dynamic = true;
+        render_scale.m_config = config;
+        return render_scale;
+    }
+
+    [[nodiscard]] constexpr float get() const {
+        return m_scale;
+    }
+
+    // returns true if the scale changed and buffers have to be resized
+    constexpr bool update(std::chrono::nanoseconds frame_time) {
+        if (!m_dynamic) return false;
+
+        double sample = frame_time.count();
+        m_average = m_frames_since_change == 0 ? sample : m_average * 0.9 + sample * 0.1;
+
+        if (++m_frames_since_change < m_config.cooldown)
+            return false;
+
+        double budget = m_config.budget.count();
+        float scale = m_scale;
+
+        if (m_average > budget)
+            scale = std::max(m_config.min, m_scale - m_config.step);
+        else if (m_average < budget * m_config.headroom)
+            scale = std::min(m_config.max, m_scale + m_config.step);
+
+        if (scale == m_scale)
+            return false;
+
+        m_scale = scale;
+        m_frames_since_change = 0;
+        return true;
+    }
+
+};
+
+consteval void test_render_scale() {
+    using namespace std::chrono_literals;
+
+    static_assert(RenderScale().get() == 1.0f);
+    static_assert(!RenderScale::fixed(0.5f).update(1s));
+
+    static_assert([] {
+        auto scale = RenderScale::dynamic({ .budget = 10ms, .min = 0.5f, .step = 0.25f, .cooldown = 2 });
+        bool changed = scale.update(20ms);
+        changed |= scale.update(20ms);
+        return changed && scale.get() == 0.75f;
+    }());
+
+    static_assert([] {
+        auto scale = RenderScale::dynamic({ .budget = 10ms, .min = 0.5f, .step = 0.25f, .cooldown = 1 });
+        for (int i = 0; i < 10; ++i)
+            scale.update(20ms);
+        return scale.get() == 0.5f;
+    }());
+
+    static_assert([] {
+        auto scale = RenderScale::dynamic({ .budget = 10ms, .min = 0.5f, .step = 0.25f, .cooldown = 1 });
+        scale.update(20ms);
+        scale.update(5ms);
+        return scale.get() == 1.0f;
+    }());
+
+    // inside the budget but without enough headroom, nothing changes
+    static_assert([] {
+        auto scale = RenderScale::dynamic({ .budget = 10ms, .min = 0.5f, .step = 0.25f, .cooldown = 1 });
+        scale.update(20ms);
+        scale.update(9ms);
+        return scale.get() == 0.75f;
+    }());
+}
+
+} // namespace util
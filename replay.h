@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "frame_profiler.h"
+#include "memory.h"
+
+// the events a session sends to its windows, recorded by WaylandConnection::record_events() and
+// replayed by the mock compositor (mock::Compositor::Options::replay) to reproduce the session's
+// rendering without the compositor it ran on
+namespace replay {
+
+enum class EventType : uint8_t {
+    Configure = 1,       // width, height, 0 leaves the size to the window
+    Frame = 2,           // a frame callback
+    PreferredScale = 3,  // wl_surface.preferred_buffer_scale
+    FractionalScale = 4, // wp_fractional_scale_v1.preferred_scale, in 120ths
+    Key = 5,             // key, state. not tied to a window, as keyboard focus isn't tracked
+};
+
+struct Event {
+    EventType type = EventType::Frame;
+    // since the recording started
+    std::chrono::microseconds time{0};
+    // in the order the windows were created in
+    uint32_t window = 0;
+    std::array<int32_t, 2> args{};
+
+    constexpr bool operator==(const Event&) const = default;
+};
+
+[[nodiscard]] constexpr size_t arg_count(EventType type) {
+    switch (type) {
+        case EventType::Configure: return 2;
+        case EventType::Frame: return 0;
+        case EventType::PreferredScale: return 1;
+        case EventType::FractionalScale: return 1;
+        case EventType::Key: return 2;
+    }
+    return 0;
+}
+
+// "WLEV" and a version, then per event its type, the time since the previous event, the window and
+// its arguments, all but the type as LEB128 varints and the arguments zigzag encoded.
+// a frame at 60 Hz takes 5 bytes
+constexpr std::array<uint8_t, 5> header { 'W', 'L', 'E', 'V', 1 };
+
+namespace detail {
+
+constexpr void write_varint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+[[nodiscard]] constexpr std::optional<uint64_t> read_varint(std::span<const uint8_t>& in) {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64 && !in.empty(); shift += 7) {
+        uint8_t byte = in.front();
+        in = in.subspan(1);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return value;
+    }
+    return std::nullopt;
+}
+
+[[nodiscard]] constexpr uint32_t zigzag(int32_t value) {
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+[[nodiscard]] constexpr int32_t unzigzag(uint32_t value) {
+    return static_cast<int32_t>((value >> 1) ^ -(value & 1));
+}
+
+} // namespace detail
+
+// events have to be ordered by time
+[[nodiscard]] constexpr std::vector<uint8_t> encode(std::span<const Event> events) {
+    std::vector<uint8_t> out(header.begin(), header.end());
+
+    std::chrono::microseconds previous{0};
+    for (const Event& event : events) {
+        out.push_back(static_cast<uint8_t>(event.type));
+        detail::write_varint(out, (event.time - previous).count());
+        detail::write_varint(out, event.window);
+        for (size_t i = 0; i < arg_count(event.type); ++i)
+            detail::write_varint(out, detail::zigzag(event.args[i]));
+        previous = event.time;
+    }
+    return out;
+}
+
+// nullopt if the data isn't a complete stream of this version
+[[nodiscard]] constexpr std::optional<std::vector<Event>> decode(std::span<const uint8_t> in) {
+    if (in.size() < header.size() || !std::equal(header.begin(), header.end(), in.begin()))
+        return std::nullopt;
+    in = in.subspan(header.size());
+
+    std::vector<Event> events;
+    std::chrono::microseconds time{0};
+
+    while (!in.empty()) {
+        Event event { .type = static_cast<EventType>(in.front()) };
+        in = in.subspan(1);
+        if (event.type < EventType::Configure || event.type > EventType::Key)
+            return std::nullopt;
+
+        auto delta = detail::read_varint(in);
+        auto window = detail::read_varint(in);
+        if (!delta || !window) return std::nullopt;
+
+        time += std::chrono::microseconds(*delta);
+        event.time = time;
+        event.window = static_cast<uint32_t>(*window);
+
+        for (size_t i = 0; i < arg_count(event.type); ++i) {
+            auto arg = detail::read_varint(in);
+            if (!arg) return std::nullopt;
+            event.args[i] = detail::unzigzag(static_cast<uint32_t>(*arg));
+        }
+        events.push_back(event);
+    }
+    return events;
+}
+
+consteval void test_encoding() {
+    static_assert(detail::unzigzag(detail::zigzag(-1)) == -1);
+    static_assert(detail::unzigzag(detail::zigzag(INT32_MIN)) == INT32_MIN);
+    static_assert(detail::zigzag(-1) == 1 && detail::zigzag(1) == 2);
+
+    static_assert([] {
+        std::array events {
+            Event { .type = EventType::Configure, .time = std::chrono::microseconds(0), .window = 0, .args = { 1920, 1080 } },
+            Event { .type = EventType::Frame, .time = std::chrono::microseconds(16'667), .window = 0 },
+            Event { .type = EventType::FractionalScale, .time = std::chrono::microseconds(20'000), .window = 1, .args = { 150 } },
+            Event { .type = EventType::Key, .time = std::chrono::microseconds(5'000'000'000), .args = { 30, -1 } },
+        };
+        auto decoded = decode(encode(events));
+        return decoded && std::ranges::equal(*decoded, events);
+    }());
+
+    // a frame 16.667 ms after the previous event
+    static_assert(encode(std::array { Event { .time = std::chrono::microseconds(16'667) } }).size() == header.size() + 5);
+
+    static_assert(!decode(std::array<uint8_t, 3> { 'W', 'L', 'E' }));
+    // cut off in the middle of a configure
+    static_assert(!decode(std::array<uint8_t, 8> { 'W', 'L', 'E', 'V', 1, 1, 0, 0 }));
+}
+
+// collects events in memory, they are only written out by save()
+class Recorder {
+    std::chrono::nanoseconds m_start = util::monotonic_now();
+    std::vector<Event> m_events;
+    util::memory::Allocation m_memory { util::memory::Subsystem::Instrumentation };
+
+public:
+    void record(EventType type, uint32_t window, std::array<int32_t, 2> args = {}) {
+        auto time = std::chrono::duration_cast<std::chrono::microseconds>(util::monotonic_now() - m_start);
+        m_events.push_back({ type, time, window, args });
+        m_memory.resize(m_events.capacity() * sizeof(Event));
+    }
+
+    [[nodiscard]] std::span<const Event> events() const {
+        return m_events;
+    }
+
+    // returns false if the file couldn't be written
+    bool save(const std::string& path) const {
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr) return false;
+
+        auto data = encode(m_events);
+        bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+        return std::fclose(file) == 0 && written;
+    }
+};
+
+// nullopt if the file can't be read or isn't a recording
+[[nodiscard]] inline std::optional<std::vector<Event>> load(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) return std::nullopt;
+
+    std::vector<uint8_t> data;
+    std::array<uint8_t, 4096> chunk;
+    while (size_t read = std::fread(chunk.data(), 1, chunk.size(), file))
+        data.insert(data.end(), chunk.begin(), chunk.begin() + read);
+    std::fclose(file);
+
+    return decode(data);
+}
+
+} // namespace replay
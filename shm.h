@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <wayland-client.h>
+
+#include "memory.h"
+
+namespace util {
+
+// anonymous shared memory file of the given size, for handing pixels to the compositor through wl_shm
+[[nodiscard]] inline int create_shm_file(size_t size) {
+
+    auto shm_path = "/wayland_shm";
+    int fd = shm_open(shm_path, O_RDWR | O_CREAT, 0600);
+    assert(fd != -1);
+    shm_unlink(shm_path);
+
+    ftruncate(fd, size);
+
+    return fd;
+}
+
+// mapping of a shm file, unmapped and closed on destruction
+class ShmMapping {
+    int m_fd = -1;
+    size_t m_size = 0;
+    uint32_t* m_data = nullptr;
+    memory::Allocation m_memory;
+
+public:
+    // XRGB8888 pixels, 4 bytes each
+    static constexpr int stride = 4;
+
+    ShmMapping(int width, int height)
+        : m_fd(create_shm_file(static_cast<size_t>(width) * height * stride))
+        , m_size(static_cast<size_t>(width) * height * stride)
+        , m_data(static_cast<uint32_t*>(mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0)))
+        , m_memory(memory::Subsystem::Shm, m_size)
+    {
+        assert(m_data != MAP_FAILED);
+    }
+
+    ShmMapping(const ShmMapping&) = delete;
+    ShmMapping& operator=(const ShmMapping&) = delete;
+
+    ~ShmMapping() {
+        munmap(m_data, m_size);
+        close(m_fd);
+    }
+
+    [[nodiscard]] std::span<uint32_t> pixels() const {
+        return { m_data, m_size / stride };
+    }
+
+    // wl_buffer over the whole mapping, the pool is only needed while the buffer is created
+    [[nodiscard]] struct wl_buffer* create_buffer(struct wl_shm* wl_shm, int width, int height) const {
+        struct wl_shm_pool* pool = wl_shm_create_pool(wl_shm, m_fd, m_size);
+        struct wl_buffer* buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride*width, WL_SHM_FORMAT_XRGB8888);
+        wl_shm_pool_destroy(pool);
+        return buffer;
+    }
+};
+
+// the test pattern of simple_example: a black frame with a square in the corner and a circle in the middle
+inline void fill_frame(std::span<uint32_t> pixels, int width, int height, float scale) {
+
+    for (int x = 0; x < width; ++x) {
+        for (int y = 0; y < height; ++y) {
+            pixels[x + y * width] = 0x0;
+        }
+    }
+
+    int square = 500 * scale;
+
+    for (int x = 0; x < square; ++x) {
+        for (int y = 0; y < square; ++y) {
+            pixels[x + y * width] = 0xffffffff;
+        }
+    }
+
+    float radius = 100.0f * scale;
+    float center_x = width / 2.0f;
+    float center_y = height / 2.0f;
+
+    for (int x = 0; x < width; ++x) {
+        for (int y = 0; y < height; ++y) {
+            float diff_x = center_x - x;
+            float diff_y = center_y - y;
+
+            float len = std::sqrt(diff_x*diff_x + diff_y*diff_y);
+            if (len <= radius) {
+                pixels[x + y * width] = 0xffffffff;
+            }
+
+        }
+    }
+}
+
+} // namespace util
@@ -2,16 +2,17 @@
 #include <functional>
 #include <print>
 #include <cassert>
-
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <unistd.h>
+#include <chrono>
+#include <cmath>
+#include <limits>
 
 #include <wayland-client.h>
 #include "xdg-shell.h"
+#include "viewporter.h"
 
-#include "string_switch.h"
+#include "util.h"
+#include "shm.h"
+#include "render_scale.h"
 
 namespace {
 
@@ -25,95 +26,65 @@ struct State {
     struct xdg_wm_base* xdg_wm_base = nullptr;
     struct xdg_surface* xdg_surface = nullptr;
     struct xdg_toplevel* xdg_toplevel = nullptr;
-};
-
 
-[[nodiscard]] int create_shm_file(size_t size) {
+    struct wp_viewporter* wp_viewporter = nullptr;
+    struct wp_viewport* wp_viewport = nullptr;
 
-    auto shm_path = "/wayland_shm";
-    int fd = shm_open(shm_path, O_RDWR | O_CREAT, 0600);
-    assert(fd != -1);
-    shm_unlink(shm_path);
-
-    ftruncate(fd, size);
+    // size of the surface, the buffer is rendered at this times render_scale
+    int width = 1920;
+    int height = 1080;
+    util::RenderScale render_scale = util::RenderScale::dynamic({ .budget = std::chrono::milliseconds(8) });
+};
 
-    return fd;
-}
 
 struct wl_buffer_listener wl_buffer_listener_ {
-    .release = [](void* data, struct wl_buffer* wl_buffer) {
+    .release = []([[maybe_unused]] void* data, struct wl_buffer* wl_buffer) {
         wl_buffer_destroy(wl_buffer);
     }
 };
 
 [[nodiscard]] struct wl_buffer* draw_frame(const State& state) {
 
-    int width = 1920;
-    int height = 1080;
-    int stride = 4;
-    size_t pool_size = width * height * stride;
+    // without a viewport the compositor can't scale the buffer up
+    float scale = state.wp_viewport == nullptr ? 1.0f : state.render_scale.get();
 
-    int fd = create_shm_file(pool_size);
+    int width = std::max(1l, std::lround(state.width * scale));
+    int height = std::max(1l, std::lround(state.height * scale));
+    util::ShmMapping mapping(width, height);
+    struct wl_buffer* buffer = mapping.create_buffer(state.wl_shm, width, height);
+    util::fill_frame(mapping.pixels(), width, height, scale);
 
-    uint32_t* pool_data = static_cast<uint32_t*>(mmap(nullptr, pool_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
-    assert(pool_data != MAP_FAILED);
-
-    struct wl_shm_pool* pool = wl_shm_create_pool(state.wl_shm, fd, pool_size);
-    struct wl_buffer* buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride*width, WL_SHM_FORMAT_XRGB8888);
-    wl_shm_pool_destroy(pool);
-    close(fd);
-
-    for (int x = 0; x < width; ++x) {
-        for (int y = 0; y < height; ++y) {
-            pool_data[x + y * width] = 0x0;
-        }
-    }
-
-    for (int x = 0; x < 500; ++x) {
-        for (int y = 0; y < 500; ++y) {
-            pool_data[x + y * width] = 0xffffffff;
-        }
-    }
-
-    float radius = 100.0f;
-    float center_x = width / 2.0f;
-    float center_y = height / 2.0f;
+    wl_buffer_add_listener(buffer, &wl_buffer_listener_, nullptr);
+    return buffer;
+}
 
-    for (int x = 0; x < width; ++x) {
-        for (int y = 0; y < height; ++y) {
-            float diff_x = center_x - x;
-            float diff_y = center_y - y;
+void present_frame(State& state) {
+    auto start = std::chrono::steady_clock::now();
 
-            float len = std::sqrt(diff_x*diff_x + diff_y*diff_y);
-            if (len <= radius) {
-                pool_data[x + y * width] = 0xffffffff;
-            }
+    auto buffer = draw_frame(state);
 
-        }
-    }
+    if (state.wp_viewport != nullptr)
+        wp_viewport_set_destination(state.wp_viewport, state.width, state.height);
 
-    munmap(pool_data, pool_size);
+    wl_surface_attach(state.wl_surface, buffer, 0, 0);
+    wl_surface_damage_buffer(state.wl_surface, 0, 0, std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max());
+    wl_surface_commit(state.wl_surface);
 
-    wl_buffer_add_listener(buffer, &wl_buffer_listener_, nullptr);
-    return buffer;
+    // a changed scale is picked up by the next draw_frame
+    state.render_scale.update(std::chrono::steady_clock::now() - start);
 }
 
 void xdg_surface_configure(void* data, struct xdg_surface* xdg_surface, uint32_t serial) {
     xdg_surface_ack_configure(xdg_surface, serial);
 
     State& state = *static_cast<State*>(data);
-
-    auto buffer = draw_frame(state);
-
-    wl_surface_attach(state.wl_surface, buffer, 0, 0);
-    wl_surface_damage_buffer(state.wl_surface, 0, 0, std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max());
-    wl_surface_commit(state.wl_surface);
+    present_frame(state);
 }
 
 void registry_handle_global(void* data, struct wl_registry* wl_registry, uint32_t name, const char* interface, uint32_t version) {
     State* state = static_cast<State*>(data);
 
-    StringSwitch<std::function<void()>>(interface)
+    util::LazyStringSwitch(interface)
         .case_(wl_compositor_interface.name, [&] {
             state->wl_compositor = static_cast<struct wl_compositor*>(wl_registry_bind(wl_registry, name, &wl_compositor_interface, version));
         })
@@ -126,12 +97,13 @@ void registry_handle_global(void* data, struct wl_registry* wl_registry, uint32_
             state->xdg_wm_base = static_cast<struct xdg_wm_base*>(wl_registry_bind(wl_registry, name, &xdg_wm_base_interface, version));
         })
 
-        .default_([] {})
-        .done()();
+        .case_(wp_viewporter_interface.name, [&] {
+            state->wp_viewporter = static_cast<struct wp_viewporter*>(wl_registry_bind(wl_registry, name, &wp_viewporter_interface, 1));
+        });
 }
 
 struct xdg_wm_base_listener xdg_wm_base_listener_ {
-    .ping = [](void* data, struct xdg_wm_base* xdg_wm_base, uint32_t serial) {
+    .ping = []([[maybe_unused]] void* data, struct xdg_wm_base* xdg_wm_base, uint32_t serial) {
         xdg_wm_base_pong(xdg_wm_base, serial);
     }
 };
@@ -142,12 +114,13 @@ struct xdg_surface_listener xdg_surface_listener_ {
 
 struct wl_registry_listener registry_listener_ {
     .global = registry_handle_global,
-    .global_remove = nullptr,
+    // only singletons are bound here, which are never removed
+    .global_remove = util::DefaultConstructedFunction<decltype(wl_registry_listener::global_remove)>::value,
 };
 
 extern struct wl_callback_listener frame_callback_listener;
 
-void frame_callback(void* data, struct wl_callback* wl_callback, uint32_t callback_data) {
+void frame_callback(void* data, struct wl_callback* wl_callback, [[maybe_unused]] uint32_t callback_data) {
     State& state = *static_cast<State*>(data);
 
     wl_callback_destroy(wl_callback);
@@ -155,11 +128,7 @@ void frame_callback(void* data, struct wl_callback* wl_callback, uint32_t callba
     struct wl_callback* frame_callback = wl_surface_frame(state.wl_surface);
     wl_callback_add_listener(frame_callback, &frame_callback_listener, &state);
 
-    struct wl_buffer* buffer = draw_frame(state);
-
-    wl_surface_attach(state.wl_surface, buffer, 0, 0);
-    wl_surface_damage_buffer(state.wl_surface, 0, 0, std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max());
-    wl_surface_commit(state.wl_surface);
+    present_frame(state);
 }
 
 struct wl_callback_listener frame_callback_listener {
@@ -181,6 +150,15 @@ int main() {
 
     state.wl_surface = wl_compositor_create_surface(state.wl_compositor);
 
+    if (state.wp_viewporter != nullptr)
+        state.wp_viewport = wp_viewporter_get_viewport(state.wp_viewporter, state.wl_surface);
+
+    // buffers are XRGB8888, so the whole surface is opaque and the compositor can skip what's behind it
+    struct wl_region* opaque_region = wl_compositor_create_region(state.wl_compositor);
+    wl_region_add(opaque_region, 0, 0, state.width, state.height);
+    wl_surface_set_opaque_region(state.wl_surface, opaque_region);
+    wl_region_destroy(opaque_region);
+
     state.xdg_surface = xdg_wm_base_get_xdg_surface(state.xdg_wm_base, state.wl_surface);
     state.xdg_toplevel = xdg_surface_get_toplevel(state.xdg_surface);
     xdg_toplevel_set_title(state.xdg_toplevel, "my app");
@@ -0,0 +1,140 @@
+// outputs being plugged in and out of the mock compositor, and what the client makes of it.
+// prints every failed check and exits with 1 if there was one, run it with ctest
+
+#include <cstdlib>
+#include <print>
+#include <string_view>
+
+#include <gfx/gfx.h>
+
+#include "../wayland.h"
+#include "../mock_compositor.h"
+
+namespace {
+
+using wayland::WaylandConnection;
+using enum WaylandConnection::OutputEvent;
+
+// the mock has no wl_drm or dmabuf, and software rendering keeps the results independent of the gpu
+const bool software_rendering = [] {
+    setenv("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+    return true;
+}();
+
+int failures = 0;
+
+void check(bool condition, std::string_view what) {
+    if (condition) return;
+    std::println(stderr, "FAILED: {}", what);
+    ++failures;
+}
+
+// destroyed in reverse, so the window goes before the connection and the connection before the compositor
+struct Fixture {
+    mock::Compositor compositor;
+    WaylandConnection connection;
+    wayland::WaylandWindow window;
+    uint64_t frames = 0;
+
+    Fixture()
+        : connection(compositor.connect_client())
+        , window(connection, "hotplug test", {}, wayland::Opacity::Opaque)
+    {
+        window.set_draw_fn([this](gfx::Renderer& rd) {
+            rd.clear_background(gfx::Color::blue());
+            ++frames;
+        });
+    }
+
+    // waits for frames until done() returns true, gives up after a few. the compositor sees requests with
+    // the flush of the next frame, and the client its answers a roundtrip later
+    template <typename Done>
+    [[nodiscard]] bool frames_until(Done&& done) {
+        for (int frame = 0; frame < 10; ++frame) {
+            uint64_t drawn = frames;
+            while (frames == drawn) {
+                if (!connection.dispatch())
+                    return false;
+            }
+            if (done())
+                return true;
+        }
+        return false;
+    }
+};
+
+// a window that enters an output with a higher scale renders at that scale, and goes back once it is unplugged
+void test_window_follows_outputs() {
+    Fixture fixture;
+    if (!fixture.frames_until([] { return true; })) {
+        check(false, "the window draws its first frame");
+        return;
+    }
+    int width = fixture.window.get_width();
+
+    int added = 0;
+    int removed = 0;
+    auto output_fn_id = fixture.connection.on_output_change([&](const WaylandConnection::Output&, WaylandConnection::OutputEvent event) {
+        added += event == Added;
+        removed += event == Removed;
+    });
+
+    uint32_t output = fixture.compositor.add_output({ .scale = 2 });
+    check(fixture.frames_until([&] { return fixture.window.get_width() == width * 2; }), "the window renders at the scale of the new output");
+    check(added == 1, "on_output_change reports the new output");
+    check(fixture.connection.outputs().size() == 2, "the connection tracks the new output");
+
+    fixture.compositor.remove_output(output);
+    check(fixture.frames_until([&] { return fixture.window.get_width() == width; }), "the window goes back to its scale when the output is unplugged");
+    check(removed == 1, "on_output_change reports the unplugged output");
+    check(fixture.connection.outputs().size() == 1, "the connection forgets the unplugged output");
+
+    fixture.connection.remove_output_fn(output_fn_id);
+}
+
+// an overlay has a window on each output as soon as the output is announced, and none once it is unplugged.
+// the compositor sees the layer surface created and destroyed
+void test_overlay_follows_outputs() {
+    Fixture fixture;
+    wayland::OutputOverlay overlay(fixture.connection, "hotplug test", wayland::Opacity::Translucent, [](gfx::Renderer& rd, const WaylandConnection::Output&) {
+        rd.clear_background(gfx::Color::red());
+    });
+    if (!fixture.frames_until([] { return true; })) {
+        check(false, "the window draws its first frame");
+        return;
+    }
+    uint64_t surfaces = fixture.compositor.stats().surfaces;
+
+    // registered after the overlay's, so it sees what the overlay made of the event
+    bool created = false;
+    bool destroyed = false;
+    auto output_fn_id = fixture.connection.on_output_change([&](const WaylandConnection::Output& output, WaylandConnection::OutputEvent event) {
+        if (event == Added)
+            created = overlay.window(output) != nullptr;
+        if (event == Removed)
+            destroyed = overlay.window(output) == nullptr;
+    });
+
+    uint32_t output = fixture.compositor.add_output({ .refresh = 144000 });
+    check(fixture.frames_until([&] { return fixture.compositor.stats().surfaces == surfaces + 1; }), "the compositor sees one more surface for the new output");
+    check(created, "the overlay has a window on the new output");
+
+    fixture.compositor.remove_output(output);
+    check(fixture.frames_until([&] { return fixture.compositor.stats().surfaces == surfaces; }), "the compositor sees the surface of the unplugged output destroyed");
+    check(destroyed, "the overlay has no window left on the unplugged output");
+
+    fixture.connection.remove_output_fn(output_fn_id);
+}
+
+} // namespace
+
+int main() {
+    test_window_follows_outputs();
+    test_overlay_follows_outputs();
+
+    if (failures != 0) {
+        std::println(stderr, "{} checks failed", failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <print>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "frame_profiler.h"
+#include "memory.h"
+
+// an opt-in tracer writing the chrome trace-event format, which chrome://tracing and ui.perfetto.dev open.
+// events are appended to a buffer of the thread recording them and only written out at exit,
+// so tracing costs a clock read and a store, and nothing at all until start() is called
+namespace util::trace {
+
+struct Event {
+    const char* name; // not copied, string literals only
+    char phase;       // 'X' for spans, 'i' for instant events
+    std::chrono::nanoseconds start;
+    std::chrono::nanoseconds duration;
+    // shown as {"arg_name": arg}, if arg_name isn't nullptr
+    const char* arg_name = nullptr;
+    int64_t arg = 0;
+};
+
+namespace detail {
+
+// never moved once written, so the events can be read while the thread keeps recording
+struct Chunk {
+    // a few seconds of frames
+    static constexpr size_t capacity = 4096;
+
+    std::array<Event, capacity> events;
+    std::unique_ptr<Chunk> next;
+};
+
+struct ThreadBuffer {
+    pid_t tid;
+    std::unique_ptr<Chunk> first = std::make_unique<Chunk>();
+    // only used by the recording thread
+    Chunk* last = first.get();
+    // events recorded so far. stored with release after the event and its chunk were written,
+    // write_file reads this many with acquire while the thread may still be recording
+    std::atomic<size_t> committed = 0;
+    memory::Allocation memory { memory::Subsystem::Tracing, sizeof(Chunk) };
+};
+
+struct State {
+    std::atomic<bool> enabled = false;
+    // guards everything below, only taken when a thread records its first event and at exit
+    std::mutex mutex;
+    std::string path;
+    // outlive their threads, so events of finished threads are written too
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+inline State& state() {
+    static State state;
+    return state;
+}
+
+inline ThreadBuffer& thread_buffer() {
+    thread_local ThreadBuffer* buffer = [] {
+        State& state = detail::state();
+        std::lock_guard lock(state.mutex);
+        return state.buffers.emplace_back(std::make_unique<ThreadBuffer>(gettid())).get();
+    }();
+    return *buffer;
+}
+
+inline void push(const Event& event) {
+    ThreadBuffer& buffer = thread_buffer();
+    size_t count = buffer.committed.load(std::memory_order_relaxed);
+    size_t index = count % Chunk::capacity;
+
+    if (count != 0 && index == 0) {
+        buffer.last->next = std::make_unique<Chunk>();
+        buffer.last = buffer.last->next.get();
+        buffer.memory.resize(buffer.memory.bytes() + sizeof(Chunk));
+    }
+
+    buffer.last->events[index] = event;
+    buffer.committed.store(count + 1, std::memory_order_release);
+}
+
+// names are written as they are, they come from string literals that need no escaping
+inline void write_file() {
+    State& state = detail::state();
+    // other threads, e.g. a capture encoder, may still record until the process is gone. what they record
+    // from here on is left out, what they committed before can be read while they do
+    state.enabled.store(false, std::memory_order_relaxed);
+    std::lock_guard lock(state.mutex);
+
+    std::FILE* file = std::fopen(state.path.c_str(), "w");
+    if (file == nullptr) {
+        std::println(stderr, "failed to write the trace to {}", state.path);
+        return;
+    }
+
+    using us = std::chrono::duration<double, std::micro>;
+    pid_t pid = getpid();
+    const char* separator = "";
+
+    std::print(file, "{{\"traceEvents\":[");
+    for (const auto& buffer : state.buffers) {
+        size_t count = buffer->committed.load(std::memory_order_acquire);
+        const Chunk* chunk = buffer->first.get();
+
+        for (size_t i = 0; i < count; ++i) {
+            if (i != 0 && i % Chunk::capacity == 0)
+                chunk = chunk->next.get();
+            const Event& event = chunk->events[i % Chunk::capacity];
+
+            std::print(file, "{}\n{{\"name\":\"{}\",\"ph\":\"{}\",\"ts\":{:.3f},\"pid\":{},\"tid\":{}",
+                separator, event.name, event.phase, us(event.start).count(), pid, buffer->tid);
+            separator = ",";
+
+            if (event.phase == 'X')
+                std::print(file, ",\"dur\":{:.3f}", us(event.duration).count());
+            else
+                std::print(file, ",\"s\":\"t\"");
+
+            if (event.arg_name != nullptr)
+                std::print(file, ",\"args\":{{\"{}\":{}}}", event.arg_name, event.arg);
+
+            std::print(file, "}}");
+        }
+    }
+    std::println(file, "\n],\"displayTimeUnit\":\"ms\"}}");
+    std::fclose(file);
+}
+
+} // namespace detail
+
+[[nodiscard]] inline bool enabled() {
+    return detail::state().enabled.load(std::memory_order_relaxed);
+}
+
+// records from now on and writes the trace to the file at exit
+inline void start(std::string path) {
+    detail::State& state = detail::state();
+    {
+        std::lock_guard lock(state.mutex);
+        state.path = std::move(path);
+    }
+
+    if (!state.enabled.exchange(true))
+        std::atexit(detail::write_file);
+}
+
+// a wayland event or anything else without a duration
+inline void instant(const char* name, const char* arg_name = nullptr, int64_t arg = 0) {
+    if (!enabled()) return;
+    detail::push({ name, 'i', monotonic_now(), {}, arg_name, arg });
+}
+
+// the lifetime of the span
+class Span {
+    const char* m_name;
+    // only set if tracing was enabled when the span started
+    std::optional<std::chrono::nanoseconds> m_start;
+
+public:
+    explicit Span(const char* name)
+        : m_name(name)
+    {
+        if (enabled())
+            m_start = monotonic_now();
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+    ~Span() {
+        if (!m_start) return;
+        detail::push({ m_name, 'X', *m_start, monotonic_now() - *m_start });
+    }
+};
+
+} // namespace util::trace
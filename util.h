@@ -1,8 +1,12 @@
 #pragma once
 
+#include <array>
+#include <bit>
+#include <cstdint>
 #include <string>
 #include <string_view>
 #include <optional>
+#include <utility>
 
 namespace util {
 
@@ -32,7 +36,7 @@ public:
     constexpr StringSwitch(std::string_view string) : m_string(string) { }
 
     constexpr StringSwitch& case_(std::string_view query, T value) {
-        if (query == m_string)
+        if (!m_value && query == m_string)
             m_value = value;
 
         return *this;
@@ -54,6 +58,77 @@ public:
 
 };
 
+// like StringSwitch, but takes callables and only invokes the one belonging to the first match.
+// nothing is stored for the cases that don't match, so lambdas passed here never get wrapped
+// in a std::function.
+template <typename T = void>
+class LazyStringSwitch {
+    const std::string_view m_string;
+    std::optional<T> m_value;
+
+public:
+    constexpr LazyStringSwitch(std::string_view string) : m_string(string) { }
+
+    template <typename Fn>
+    constexpr LazyStringSwitch& case_(std::string_view query, Fn&& fn) {
+        if (!m_value && query == m_string)
+            m_value = std::forward<Fn>(fn)();
+
+        return *this;
+    }
+
+    // ends the switch, so no case_ can follow and be skipped because the default already ran
+    template <typename Fn>
+    [[nodiscard]] constexpr T default_(Fn&& fn) {
+        if (!m_value)
+            return std::forward<Fn>(fn)();
+
+        return *m_value;
+    }
+
+    constexpr operator T() const {
+        return done();
+    }
+
+    [[nodiscard]] constexpr T done() const {
+        return m_value.value_or(T{});
+    }
+
+};
+
+template <>
+class LazyStringSwitch<void> {
+    const std::string_view m_string;
+    bool m_matched = false;
+
+public:
+    constexpr LazyStringSwitch(std::string_view string) : m_string(string) { }
+
+    template <typename Fn>
+    constexpr LazyStringSwitch& case_(std::string_view query, Fn&& fn) {
+        if (!m_matched && query == m_string) {
+            m_matched = true;
+            std::forward<Fn>(fn)();
+        }
+
+        return *this;
+    }
+
+    // ends the switch, so no case_ can follow and be skipped because the default already ran
+    template <typename Fn>
+    constexpr void default_(Fn&& fn) {
+        if (!m_matched) {
+            m_matched = true;
+            std::forward<Fn>(fn)();
+        }
+    }
+
+    [[nodiscard]] constexpr bool matched() const {
+        return m_matched;
+    }
+
+};
+
 consteval void test_string_switch() {
 
     static_assert(StringSwitch<int>("foo")
@@ -73,6 +148,153 @@ consteval void test_string_switch() {
     .case_("baz", 3)
     == 0);
 
+    static_assert(StringSwitch<int>("foo")
+    .case_("foo", 1)
+    .case_("foo", 2)
+    == 1);
+
+    static_assert(LazyStringSwitch<int>("foo")
+    .case_("bar", [] { return 2; })
+    .case_("foo", [] { return 1; })
+    .case_("foo", [] { return 3; })
+    == 1);
+
+    static_assert(LazyStringSwitch<int>("foo")
+    .case_("bar", [] { return 2; })
+    .default_([] { return 4; })
+    == 4);
+
+    static_assert(LazyStringSwitch<int>("foo")
+    .case_("foo", [] { return 1; })
+    .default_([] { return 4; })
+    == 1);
+
+    static_assert(LazyStringSwitch<int>("foo")
+    .case_("bar", [] { return 2; })
+    == 0);
+
+    static_assert([] {
+        int calls = 0;
+        LazyStringSwitch("baz")
+            .case_("bar", [&] { calls += 1; })
+            .case_("baz", [&] { calls += 10; })
+            .case_("baz", [&] { calls += 100; })
+            .default_([&] { calls += 1000; });
+        return calls;
+    }() == 10);
+
+}
+
+// reads up to eight bytes starting at `offset` into an integer, usable in constant expressions
+[[nodiscard]] constexpr std::uint64_t load_bytes(std::string_view string, std::size_t offset) {
+    std::uint64_t word = 0;
+
+    for (std::size_t i = offset; i < string.size() && i < offset + 8; ++i)
+        word = word << 8 | static_cast<unsigned char>(string[i]);
+
+    return word;
+}
+
+// seeded hash over the length and the first and last eight bytes, so it costs the same for any
+// string length. the seed is varied by PerfectHashMap until all keys land in distinct slots
+[[nodiscard]] constexpr std::uint64_t hash_string(std::string_view string, std::uint64_t seed = 0) {
+    std::uint64_t tail_offset = string.size() > 8 ? string.size() - 8 : 0;
+
+    std::uint64_t hash = (seed + string.size()) * 0x9e3779b97f4a7c15;
+    hash = (hash ^ load_bytes(string, 0)) * 0xbf58476d1ce4e5b9;
+    hash = (hash ^ load_bytes(string, tail_offset)) * 0x94d049bb133111eb;
+
+    return hash ^ (hash >> 31);
+}
+
+// string-keyed lookup table with a collision-free hash, built at compile time.
+// lookups hash the query once and do a single string comparison against the candidate slot.
+template <typename T, std::size_t N>
+class PerfectHashMap {
+public:
+    using Entry = std::pair<std::string_view, T>;
+
+private:
+    static_assert(N > 0 && N < UINT16_MAX);
+    static constexpr std::size_t m_table_size = std::bit_ceil(N) * 4;
+
+    std::array<Entry, N> m_entries;
+    // index into m_entries plus one, zero marks an empty slot
+    std::array<std::uint16_t, m_table_size> m_slots{};
+    std::uint64_t m_seed = 0;
+
+public:
+    consteval PerfectHashMap(std::array<Entry, N> entries) : m_entries(entries) {
+        for (; m_seed < 1'000'000; ++m_seed) {
+            if (try_seed())
+                return;
+        }
+
+        // only happens if two keys share their length and their first and last eight bytes,
+        // fails the constant evaluation
+        throw "no collision-free seed found";
+    }
+
+    [[nodiscard]] constexpr std::optional<std::size_t> index_of(std::string_view key) const {
+        std::uint16_t slot = m_slots[slot_of(key)];
+        if (slot == 0 || m_entries[slot - 1].first != key)
+            return std::nullopt;
+
+        return slot - 1;
+    }
+
+    [[nodiscard]] constexpr const T* find(std::string_view key) const {
+        auto index = index_of(key);
+        return index ? &m_entries[*index].second : nullptr;
+    }
+
+    [[nodiscard]] constexpr bool contains(std::string_view key) const {
+        return index_of(key).has_value();
+    }
+
+    [[nodiscard]] constexpr const std::array<Entry, N>& entries() const {
+        return m_entries;
+    }
+
+    [[nodiscard]] static constexpr std::size_t size() {
+        return N;
+    }
+
+private:
+    [[nodiscard]] constexpr std::size_t slot_of(std::string_view key) const {
+        return hash_string(key, m_seed) & (m_table_size - 1);
+    }
+
+    [[nodiscard]] constexpr bool try_seed() {
+        m_slots = {};
+
+        for (std::size_t i = 0; i < N; ++i) {
+            std::uint16_t& slot = m_slots[slot_of(m_entries[i].first)];
+            if (slot != 0) return false;
+            slot = i + 1;
+        }
+
+        return true;
+    }
+
+};
+
+consteval void test_perfect_hash_map() {
+
+    constexpr PerfectHashMap<int, 3> map({{
+        { "wl_compositor", 1 },
+        { "wl_seat", 2 },
+        { "xdg_wm_base", 3 },
+    }});
+
+    static_assert(*map.find("wl_compositor") == 1);
+    static_assert(*map.find("wl_seat") == 2);
+    static_assert(*map.find("xdg_wm_base") == 3);
+    static_assert(map.find("wl_output") == nullptr);
+    static_assert(!map.contains(""));
+    static_assert(map.index_of("wl_seat") == 1);
+    static_assert(map.entries()[2].first == "xdg_wm_base");
+
 }
 
 template <typename... Ts>
@@ -0,0 +1,2136 @@
+#pragma once
+
+#include <functional>
+#include <print>
+#include <cassert>
+#include <format>
+#include <algorithm>
+#include <memory>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <cerrno>
+#include <csignal>
+#include <atomic>
+#include <limits>
+
+#include <poll.h>
+
+// redirects the protocol functions when counting messages, so it goes before every wayland header
+#include "protocol_stats.h"
+
+#include <wayland-client.h>
+#include <wayland-egl.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <xkbcommon/xkbcommon.h>
+#include "xdg-shell.h"
+#include "wlr-layer-shell-unstable-v1.h"
+#include "viewporter.h"
+#include "fractional-scale-v1.h"
+#include "single-pixel-buffer-v1.h"
+#include "presentation-time.h"
+#include "tearing-control-v1.h"
+#include "content-type-v1.h"
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <gfx/gfx.h>
+
+#include "util.h"
+#include "render_scale.h"
+#include "frame_profiler.h"
+#include "tracer.h"
+#include "replay.h"
+#include "capture.h"
+#include "memory.h"
+
+namespace wayland {
+
+// opaque windows get an EGL config without alpha and an opaque region covering the surface,
+// so the compositor can skip blending and whatever is behind them, or scan them out directly
+enum class Opacity { Translucent, Opaque };
+
+// where a popup is placed relative to its parent, see xdg_positioner
+struct PopupPlacement {
+    int width = 0;
+    int height = 0;
+    // the rectangle on the parent the popup is placed against, in logical coordinates of the parent
+    int anchor_x = 0;
+    int anchor_y = 0;
+    int anchor_width = 1;
+    int anchor_height = 1;
+    xdg_positioner_anchor anchor = XDG_POSITIONER_ANCHOR_BOTTOM;
+    xdg_positioner_gravity gravity = XDG_POSITIONER_GRAVITY_BOTTOM;
+    // bitmask of xdg_positioner_constraint_adjustment
+    uint32_t constraint_adjustment = XDG_POSITIONER_CONSTRAINT_ADJUSTMENT_SLIDE_X | XDG_POSITIONER_CONSTRAINT_ADJUSTMENT_FLIP_Y;
+    int offset_x = 0;
+    int offset_y = 0;
+
+    bool operator==(const PopupPlacement&) const = default;
+};
+
+class WaylandWindow;
+
+// a connection to the compositor that any number of windows can share, so every extra window
+// costs a surface and a GL context instead of a socket, a registry roundtrip and an EGLDisplay
+class WaylandConnection {
+    friend WaylandWindow;
+
+public:
+    // optional features, determined once at startup
+    struct Capabilities {
+        uint32_t compositor_version = 0;
+        uint32_t layer_shell_version = 0;
+        bool buffer_age = false;       // EGL_EXT_buffer_age
+        bool presentation = false;     // wp_presentation
+        bool tearing_control = false;  // wp_tearing_control_manager_v1
+        bool content_type = false;     // wp_content_type_manager_v1
+        bool viewporter = false;       // wp_viewporter
+        bool fractional_scale = false; // wp_fractional_scale_manager_v1
+        bool single_pixel_buffer = false; // wp_single_pixel_buffer_manager_v1
+    };
+
+    struct Output {
+        uint32_t name = 0; // registry name
+        struct wl_output* wl_output = nullptr;
+        std::string connector; // e.g. "DP-1", only sent by wl_output v4
+        int32_t width = 0;
+        int32_t height = 0;
+        int32_t refresh = 0; // in mHz
+        int32_t scale = 1;
+        bool announced = false;
+    };
+
+    enum class OutputEvent { Added, Changed, Removed };
+    using OutputFn = std::function<void(const Output&, OutputEvent)>;
+    using OutputFnId = uint32_t;
+
+private:
+    struct Seat {
+        uint32_t name = 0; // registry name
+        struct wl_seat* wl_seat = nullptr;
+        struct wl_keyboard* wl_keyboard = nullptr;
+    };
+
+    wl_display*    m_wl_display    = nullptr;
+    wl_registry*   m_wl_registry   = nullptr;
+    wl_compositor* m_wl_compositor = nullptr;
+    wl_subcompositor* m_wl_subcompositor = nullptr;
+
+    xdg_wm_base* m_xdg_wm_base = nullptr;
+    zwlr_layer_shell_v1* m_zwlr_layer_shell = nullptr;
+    wp_viewporter* m_wp_viewporter = nullptr;
+    wp_fractional_scale_manager_v1* m_wp_fractional_scale_manager = nullptr;
+    wp_single_pixel_buffer_manager_v1* m_wp_single_pixel_buffer_manager = nullptr;
+
+    wp_presentation* m_wp_presentation = nullptr;
+    // clock domain of the presentation timestamps, announced by wp_presentation.clock_id
+    clockid_t m_presentation_clock = CLOCK_MONOTONIC;
+
+    wp_tearing_control_manager_v1* m_wp_tearing_control_manager = nullptr;
+    wp_content_type_manager_v1* m_wp_content_type_manager = nullptr;
+
+    EGLDisplay m_egl_display = EGL_NO_DISPLAY;
+    // never made current, every window's context shares textures and shaders with it
+    EGLContext m_egl_context = EGL_NO_CONTEXT;
+    // indexed by Opacity, chosen on first use
+    std::array<EGLConfig, 2> m_egl_configs{};
+
+    static constexpr std::array m_egl_context_attribs {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 5,
+        EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+        EGL_NONE
+    };
+
+    // unique_ptr, as listeners look outputs up by their wl_output and hand out references
+    std::vector<std::unique_ptr<Output>> m_outputs;
+    std::vector<Seat> m_seats;
+    std::vector<std::pair<OutputFnId, OutputFn>> m_output_fns;
+    OutputFnId m_next_output_fn_id = 0;
+
+    // notified when an output they may be shown on changes
+    std::vector<WaylandWindow*> m_windows;
+
+    // get_popup copies the positioner state, so one positioner serves every popup with the same placement.
+    // most recently created last
+    std::vector<std::pair<PopupPlacement, xdg_positioner*>> m_positioners;
+    static constexpr size_t m_max_positioners = 16;
+
+    Capabilities m_capabilities;
+    // when the current dispatch woke up, the event dispatch phase of a frame runs from here to its render
+    std::chrono::nanoseconds m_dispatch_start{0};
+
+    // set by the signal handler, the summaries are printed by the next dispatch
+    static inline std::atomic<bool> m_report_requested = false;
+    // the protocol statistics of the last report, rates are reported over the time since
+    util::protocol_stats::Snapshot m_protocol_snapshot;
+
+    // set by record_events(), saved when the connection is destroyed
+    std::optional<replay::Recorder> m_recorder;
+    std::string m_recording_path;
+    // numbers windows in the order they are created, which is how a replay finds them again
+    uint32_t m_next_window_id = 0;
+
+    // checked once per dispatch, see set_memory_budget()
+    std::optional<size_t> m_memory_budget;
+    bool m_over_memory_budget = false;
+    static_assert(std::atomic<bool>::is_always_lock_free);
+
+public:
+    // connects to the given socket, or to $WAYLAND_DISPLAY if it is nullptr
+    explicit WaylandConnection(const char* name = nullptr) {
+        init(wl_display_connect(name));
+    }
+
+    // takes ownership of an already connected socket, e.g. one end of a socketpair to an in-process compositor
+    explicit WaylandConnection(int fd) {
+        init(wl_display_connect_to_fd(fd));
+    }
+
+    WaylandConnection(const WaylandConnection&) = delete;
+    WaylandConnection& operator=(const WaylandConnection&) = delete;
+
+    ~WaylandConnection() {
+        assert(m_windows.empty());
+
+        if (m_recorder && !m_recorder->save(m_recording_path))
+            std::println(stderr, "failed to save the recorded events to {}", m_recording_path);
+
+        for (auto& [placement, positioner] : m_positioners)
+            xdg_positioner_destroy(positioner);
+
+        eglDestroyContext(m_egl_display, m_egl_context);
+        eglTerminate(m_egl_display);
+        wl_display_disconnect(m_wl_display);
+    }
+
+    [[nodiscard]] const std::vector<std::unique_ptr<Output>>& outputs() const {
+        return m_outputs;
+    }
+
+    // called when an output is plugged in, changes its mode or scale, or is unplugged,
+    // so buffers can be reallocated right away instead of on the next configure.
+    // returns an id for remove_output_fn()
+    OutputFnId on_output_change(OutputFn output_fn) {
+        m_output_fns.emplace_back(m_next_output_fn_id, std::move(output_fn));
+        return m_next_output_fn_id++;
+    }
+
+    void remove_output_fn(OutputFnId id) {
+        std::erase_if(m_output_fns, [&](const auto& entry) { return entry.first == id; });
+    }
+
+    [[nodiscard]] const Capabilities& capabilities() const {
+        return m_capabilities;
+    }
+
+    // the event loop for every window on this connection, returns once the connection is lost
+    void run() {
+        while (dispatch());
+    }
+
+    // blocks until events were read or a signal arrived, returns false once the connection is lost
+    bool dispatch() {
+        if (wl_display_prepare_read(m_wl_display) == 0) {
+            wl_display_flush(m_wl_display);
+
+            pollfd fd { .fd = wl_display_get_fd(m_wl_display), .events = POLLIN, .revents = 0 };
+            if (poll(&fd, 1, -1) == -1) {
+                // before anything that may print and overwrite it
+                int err = errno;
+                wl_display_cancel_read(m_wl_display);
+                report_if_requested();
+                return err == EINTR;
+            }
+
+            m_dispatch_start = util::monotonic_now();
+            util::trace::Span span("read events");
+            if (wl_display_read_events(m_wl_display) == -1)
+                return false;
+        } else {
+            // events were already queued
+            m_dispatch_start = util::monotonic_now();
+        }
+
+        report_if_requested();
+        enforce_memory_budget();
+        util::trace::Span span("dispatch");
+        return wl_display_dispatch_pending(m_wl_display) != -1;
+    }
+
+    // records the configures, frame callbacks, scale changes and keys every window receives from now on,
+    // and saves them to the file when the connection is destroyed. for replaying with mock::Compositor
+    void record_events(std::string path) {
+        m_recorder.emplace();
+        m_recording_path = std::move(path);
+    }
+
+    // when the memory accounted for in util::memory, without trace buffers, goes over the budget, trim_memory()
+    // is called by the next dispatch, and again only once it went back under it in between. the accounting is
+    // process-wide, so the budget is meant for one connection per process
+    void set_memory_budget(std::optional<size_t> bytes) {
+        m_memory_budget = bytes;
+        m_over_memory_budget = false;
+    }
+
+    // drops what can be recreated or done without: the cached positioners, and frames in flight
+    // or waiting to be written for windows that capture. defined after WaylandWindow
+    void trim_memory();
+
+    // prints the frame profile of every window to stderr whenever the process receives the signal,
+    // the memory usage, and the message counts of the connection if they are compiled in.
+    // the handler only sets a flag, the report is printed by the next dispatch()
+    static void report_on_signal(int signal = SIGUSR1) {
+        struct sigaction action {};
+        action.sa_handler = [](int) { m_report_requested.store(true, std::memory_order_relaxed); };
+        sigemptyset(&action.sa_mask);
+        // no SA_RESTART, so the signal interrupts the poll in dispatch()
+        action.sa_flags = 0;
+        sigaction(signal, &action, nullptr);
+    }
+
+private:
+    struct BoundGlobal {
+        void* proxy;
+        uint32_t name;
+        uint32_t version;
+    };
+
+    struct Global {
+        const wl_interface* interface;
+        uint32_t min_version;
+        uint32_t max_version;
+        bool required;
+        void (*store)(WaylandConnection& self, BoundGlobal global);
+    };
+
+    // m_global_entries by interface name
+    [[nodiscard]] static const auto& globals() {
+        static constexpr util::PerfectHashMap<Global, m_global_entries.size()> globals(m_global_entries);
+        return globals;
+    }
+
+    static void bind_globals(void* data, struct wl_registry* wl_registry, uint32_t name, const char* interface, uint32_t version) {
+        WaylandConnection& self = *static_cast<WaylandConnection*>(data);
+
+        auto index = globals().index_of(interface);
+        if (!index) return;
+
+        const Global& global = globals().entries()[*index].second;
+        if (version < global.min_version) return;
+
+        // never bind a newer version than our listeners or the generated protocol code know about
+        version = std::min(version, global.max_version);
+        version = std::min<uint32_t>(version, global.interface->version);
+        void* proxy = wl_registry_bind(wl_registry, name, global.interface, version);
+
+        global.store(self, { proxy, name, version });
+        self.m_global_versions[*index] = version;
+    }
+
+    // outputs and seats can come and go at any time, the other globals are expected to stay
+    static void remove_global(void* data, [[maybe_unused]] struct wl_registry* wl_registry, uint32_t name) {
+        WaylandConnection& self = *static_cast<WaylandConnection*>(data);
+
+        self.remove_output(name);
+        self.remove_seat(name);
+    }
+
+    // display is nullptr if connecting failed
+    void init(wl_display* display) {
+        m_wl_display = display;
+        if (m_wl_display == nullptr)
+            throw std::runtime_error("failed to connect to the wayland display");
+        m_dispatch_start = util::monotonic_now();
+        m_protocol_snapshot = util::protocol_stats::snapshot();
+
+        m_wl_registry = wl_display_get_registry(m_wl_display);
+        wl_registry_add_listener(m_wl_registry, &m_wl_registry_listener, this);
+        wl_display_roundtrip(m_wl_display);
+
+        check_required_globals();
+
+        if (!init_egl())
+            throw std::runtime_error("failed to initialize EGL");
+    }
+
+    void check_required_globals() const {
+        for (size_t index = 0; index < globals().size(); ++index) {
+            const auto& [interface, global] = globals().entries()[index];
+
+            if (global.required && m_global_versions[index] == 0)
+                throw std::runtime_error(std::format("compositor does not support {} version {}", interface, global.min_version));
+        }
+    }
+
+    void add_output(wl_output* output, uint32_t name, uint32_t version) {
+        auto& tracked = m_outputs.emplace_back(std::make_unique<Output>());
+        tracked->name = name;
+        tracked->wl_output = output;
+        wl_output_add_listener(output, &m_wl_output_listener, this);
+
+        // wl_output v1 has no done event, so there is nothing to wait for
+        if (version < WL_OUTPUT_DONE_SINCE_VERSION)
+            announce_output(*tracked);
+    }
+
+    // defined after WaylandWindow, as they notify the windows
+    void remove_output(uint32_t name);
+    void announce_output(Output& output);
+    void report_if_requested();
+
+    void enforce_memory_budget() {
+        if (!m_memory_budget) return;
+
+        auto usage = util::memory::usage();
+        bool over = usage.budgeted() > *m_memory_budget;
+
+        // trimming on every dispatch while over would throw the positioner cache away each frame
+        if (over && !m_over_memory_budget) {
+            std::print(stderr, "over the memory budget, trimming\n{}", util::memory::format(usage, m_memory_budget));
+            trim_memory();
+        }
+        m_over_memory_budget = over;
+    }
+
+    void record(replay::EventType type, uint32_t window, std::array<int32_t, 2> args = {}) {
+        if (m_recorder)
+            m_recorder->record(type, window, args);
+    }
+
+    [[nodiscard]] Output* find_output(wl_output* wl_output) const {
+        auto it = std::ranges::find(m_outputs, wl_output, [](const auto& output) { return output->wl_output; });
+        return it == m_outputs.end() ? nullptr : it->get();
+    }
+
+    void add_seat(wl_seat* seat, uint32_t name) {
+        m_seats.push_back({ .name = name, .wl_seat = seat });
+        wl_seat_add_listener(seat, &m_wl_seat_listener, this);
+    }
+
+    void remove_seat(uint32_t name) {
+        auto it = std::ranges::find(m_seats, name, &Seat::name);
+        if (it == m_seats.end()) return;
+
+        release_keyboard(*it);
+
+        if (wl_seat_get_version(it->wl_seat) >= WL_SEAT_RELEASE_SINCE_VERSION)
+            wl_seat_release(it->wl_seat);
+        else
+            wl_seat_destroy(it->wl_seat);
+
+        m_seats.erase(it);
+    }
+
+    static void release_keyboard(Seat& seat) {
+        if (seat.wl_keyboard == nullptr) return;
+
+        if (wl_keyboard_get_version(seat.wl_keyboard) >= WL_KEYBOARD_RELEASE_SINCE_VERSION)
+            wl_keyboard_release(seat.wl_keyboard);
+        else
+            wl_keyboard_destroy(seat.wl_keyboard);
+
+        seat.wl_keyboard = nullptr;
+    }
+
+    static void seat_capabilities(void* data, struct wl_seat* wl_seat, uint32_t capabilities) {
+        WaylandConnection& self = *static_cast<WaylandConnection*>(data);
+
+        auto it = std::ranges::find(self.m_seats, wl_seat, &Seat::wl_seat);
+        if (it == self.m_seats.end()) return;
+
+        bool has_keyboard = capabilities & WL_SEAT_CAPABILITY_KEYBOARD;
+
+        if (has_keyboard && it->wl_keyboard == nullptr) {
+            it->wl_keyboard = wl_seat_get_keyboard(wl_seat);
+            wl_keyboard_add_listener(it->wl_keyboard, &m_wl_keyboard_listener, &self);
+        }
+
+        if (!has_keyboard)
+            release_keyboard(*it);
+    }
+
+    [[nodiscard]] xdg_positioner* positioner(const PopupPlacement& placement) {
+        auto it = std::ranges::find(m_positioners, placement, [](const auto& entry) { return entry.first; });
+        if (it != m_positioners.end()) return it->second;
+
+        if (m_positioners.size() == m_max_positioners) {
+            xdg_positioner_destroy(m_positioners.front().second);
+            m_positioners.erase(m_positioners.begin());
+        }
+
+        xdg_positioner* positioner = xdg_wm_base_create_positioner(m_xdg_wm_base);
+        xdg_positioner_set_size(positioner, placement.width, placement.height);
+        xdg_positioner_set_anchor_rect(positioner, placement.anchor_x, placement.anchor_y, placement.anchor_width, placement.anchor_height);
+        xdg_positioner_set_anchor(positioner, placement.anchor);
+        xdg_positioner_set_gravity(positioner, placement.gravity);
+        xdg_positioner_set_constraint_adjustment(positioner, placement.constraint_adjustment);
+        xdg_positioner_set_offset(positioner, placement.offset_x, placement.offset_y);
+
+        m_positioners.emplace_back(placement, positioner);
+        return positioner;
+    }
+
+    // returns nullptr if there is no matching config
+    [[nodiscard]] EGLConfig choose_config(Opacity opacity) {
+        EGLConfig& cached = m_egl_configs[static_cast<size_t>(opacity)];
+        if (cached != nullptr) return cached;
+
+        EGLint alpha_size = opacity == Opacity::Opaque ? 0 : 8;
+
+        std::array config_attribs {
+            EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+            EGL_RED_SIZE,   8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE,  8,
+            EGL_ALPHA_SIZE, alpha_size,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+
+        EGLint config_count;
+        eglGetConfigs(m_egl_display, nullptr, 0, &config_count);
+
+        std::vector<EGLConfig> configs(config_count);
+
+        EGLint n;
+        eglChooseConfig(m_egl_display, config_attribs.data(), configs.data(), config_count, &n);
+        if (n == 0) return nullptr;
+        configs.resize(n);
+
+        // EGL_ALPHA_SIZE is a minimum and configs with more color bits sort first,
+        // so an alpha-free (XRGB) config has to be picked out explicitly
+        auto matching_alpha = std::ranges::find_if(configs, [&](EGLConfig config) {
+            EGLint value;
+            eglGetConfigAttrib(m_egl_display, config, EGL_ALPHA_SIZE, &value);
+            return value == alpha_size;
+        });
+
+        cached = matching_alpha != configs.end() ? *matching_alpha : configs.front();
+        return cached;
+    }
+
+    // returns true on success
+    [[nodiscard]] bool init_egl() {
+        m_egl_display = eglGetDisplay(m_wl_display);
+        if (m_egl_display == EGL_NO_DISPLAY) return false;
+
+        EGLint major, minor;
+        if (eglInitialize(m_egl_display, &major, &minor) != EGL_TRUE) return false;
+
+        if (!eglBindAPI(EGL_OPENGL_API)) return false;
+
+        EGLConfig config = choose_config(Opacity::Translucent);
+        if (config == nullptr) return false;
+
+        m_egl_context = eglCreateContext(m_egl_display, config, EGL_NO_CONTEXT, m_egl_context_attribs.data());
+        if (m_egl_context == EGL_NO_CONTEXT) return false;
+
+        std::string_view extensions = eglQueryString(m_egl_display, EGL_EXTENSIONS);
+        m_capabilities.buffer_age = extensions.contains("EGL_EXT_buffer_age");
+
+        return true;
+    }
+
+    static inline xdg_wm_base_listener m_xdg_wm_base_listener {
+        .ping = []([[maybe_unused]] void* data, struct xdg_wm_base* xdg_wm_base, uint32_t serial) {
+            xdg_wm_base_pong(xdg_wm_base, serial);
+        }
+    };
+
+    static inline wl_registry_listener m_wl_registry_listener {
+        .global = bind_globals,
+        .global_remove = remove_global,
+    };
+
+    static inline wl_output_listener m_wl_output_listener {
+        .geometry = util::DefaultConstructedFunction<decltype(wl_output_listener::geometry)>::value,
+        .mode = [](void* data, struct wl_output* wl_output, uint32_t flags, int32_t width, int32_t height, int32_t refresh) {
+            WaylandConnection& self = *static_cast<WaylandConnection*>(data);
+            Output* output = self.find_output(wl_output);
+
+            if (output == nullptr || !(flags & WL_OUTPUT_MODE_CURRENT)) return;
+            output->width = width;
+            output->height = height;
+            output->refresh = refresh;
+        },
+        .done = [](void* data, struct wl_output* wl_output) {
+            WaylandConnection& self = *static_cast<WaylandConnection*>(data);
+
+            if (Output* output = self.find_output(wl_output))
+                self.announce_output(*output);
+        },
+        .scale = [](void* data, struct wl_output* wl_output, int32_t factor) {
+            WaylandConnection& self = *static_cast<WaylandConnection*>(data);
+
+            if (Output* output = self.find_output(wl_output))
+                output->scale = factor;
+        },
+        .name = [](void* data, struct wl_output* wl_output, const char* name) {
+            WaylandConnection& self = *static_cast<WaylandConnection*>(data);
+
+            if (Output* output = self.find_output(wl_output))
+                output->connector = name;
+        },
+        .description = util::DefaultConstructedFunction<decltype(wl_output_listener::description)>::value,
+    };
+
+    static inline wl_seat_listener m_wl_seat_listener {
+        .capabilities = seat_capabilities,
+        .name         = util::DefaultConstructedFunction<decltype(wl_seat_listener::name)>::value,
+    };
+
+    static inline wp_presentation_listener m_wp_presentation_listener {
+        .clock_id = [](void* data, [[maybe_unused]] struct wp_presentation* wp_presentation, uint32_t clk_id) {
+            WaylandConnection& self = *static_cast<WaylandConnection*>(data);
+            self.m_presentation_clock = static_cast<clockid_t>(clk_id);
+        },
+    };
+
+    static inline wl_keyboard_listener m_wl_keyboard_listener {
+        .keymap      = util::DefaultConstructedFunction<decltype(wl_keyboard_listener::keymap)>::value,
+        .enter       = util::DefaultConstructedFunction<decltype(wl_keyboard_listener::enter)>::value,
+        .leave       = util::DefaultConstructedFunction<decltype(wl_keyboard_listener::leave)>::value,
+        .key         = [](void* data, [[maybe_unused]] struct wl_keyboard* wl_keyboard, [[maybe_unused]] uint32_t serial,
+                          [[maybe_unused]] uint32_t time, uint32_t key, uint32_t state) {
+            util::trace::instant("key", "key", key);
+            WaylandConnection& self = *static_cast<WaylandConnection*>(data);
+            self.record(replay::EventType::Key, 0, { static_cast<int32_t>(key), static_cast<int32_t>(state) });
+        },
+        .modifiers   = util::DefaultConstructedFunction<decltype(wl_keyboard_listener::modifiers)>::value,
+        .repeat_info = util::DefaultConstructedFunction<decltype(wl_keyboard_listener::repeat_info)>::value,
+    };
+
+    // every global we know about, keys have to match the `name` field of the corresponding wl_interface.
+    // max_version is the newest version whose events our listeners handle.
+    // defined last, as the store functions use the rest of the class
+    static constexpr auto m_global_entries = std::to_array<std::pair<std::string_view, Global>>({
+        { "wl_compositor", { &wl_compositor_interface, 1, 6, true, [](WaylandConnection& self, BoundGlobal global) {
+            self.m_wl_compositor = static_cast<wl_compositor*>(global.proxy);
+            self.m_capabilities.compositor_version = global.version;
+        }}},
+
+        { "xdg_wm_base", { &xdg_wm_base_interface, 1, 7, true, [](WaylandConnection& self, BoundGlobal global) {
+            self.m_xdg_wm_base = static_cast<xdg_wm_base*>(global.proxy);
+            xdg_wm_base_add_listener(self.m_xdg_wm_base, &m_xdg_wm_base_listener, nullptr);
+        }}},
+
+        { "wl_subcompositor", { &wl_subcompositor_interface, 1, 1, false, [](WaylandConnection& self, BoundGlobal global) {
+            self.m_wl_subcompositor = static_cast<wl_subcompositor*>(global.proxy);
+        }}},
+
+        { "wl_seat", { &wl_seat_interface, 1, 9, false, [](WaylandConnection& self, BoundGlobal global) {
+            self.add_seat(static_cast<wl_seat*>(global.proxy), global.name);
+        }}},
+
+        { "wl_output", { &wl_output_interface, 1, 4, false, [](WaylandConnection& self, BoundGlobal global) {
+            self.add_output(static_cast<wl_output*>(global.proxy), global.name, global.version);
+        }}},
+
+        { "zwlr_layer_shell_v1", { &zwlr_layer_shell_v1_interface, 1, 5, false, [](WaylandConnection& self, BoundGlobal global) {
+            self.m_zwlr_layer_shell = static_cast<zwlr_layer_shell_v1*>(global.proxy);
+            self.m_capabilities.layer_shell_version = global.version;
+        }}},
+
+        { "wp_presentation", { &wp_presentation_interface, 1, 2, false, [](WaylandConnection& self, BoundGlobal global) {
+            self.m_wp_presentation = static_cast<wp_presentation*>(global.proxy);
+            wp_presentation_add_listener(self.m_wp_presentation, &m_wp_presentation_listener, &self);
+            self.m_capabilities.presentation = true;
+        }}},
+
+        { "wp_tearing_control_manager_v1", { &wp_tearing_control_manager_v1_interface, 1, 1, false, [](WaylandConnection& self, BoundGlobal global) {
+            self.m_wp_tearing_control_manager = static_cast<wp_tearing_control_manager_v1*>(global.proxy);
+            self.m_capabilities.tearing_control = true;
+        }}},
+
+        { "wp_content_type_manager_v1", { &wp_content_type_manager_v1_interface, 1, 1, false, [](WaylandConnection& self, BoundGlobal global) {
+            self.m_wp_content_type_manager = static_cast<wp_content_type_manager_v1*>(global.proxy);
+            self.m_capabilities.content_type = true;
+        }}},
+
+        { "wp_viewporter", { &wp_viewporter_interface, 1, 1, false, [](WaylandConnection& self, BoundGlobal global) {
+            self.m_wp_viewporter = static_cast<wp_viewporter*>(global.proxy);
+            self.m_capabilities.viewporter = true;
+        }}},
+
+        { "wp_fractional_scale_manager_v1", { &wp_fractional_scale_manager_v1_interface, 1, 1, false, [](WaylandConnection& self, BoundGlobal global) {
+            self.m_wp_fractional_scale_manager = static_cast<wp_fractional_scale_manager_v1*>(global.proxy);
+            self.m_capabilities.fractional_scale = true;
+        }}},
+
+        { "wp_single_pixel_buffer_manager_v1", { &wp_single_pixel_buffer_manager_v1_interface, 1, 1, false, [](WaylandConnection& self, BoundGlobal global) {
+            self.m_wp_single_pixel_buffer_manager = static_cast<wp_single_pixel_buffer_manager_v1*>(global.proxy);
+            self.m_capabilities.single_pixel_buffer = true;
+        }}},
+    });
+
+    // negotiated version of each entry in globals(), 0 if not advertised
+    std::array<uint32_t, m_global_entries.size()> m_global_versions{};
+};
+
+// placement and behaviour of a layer surface, see wlr-layer-shell-unstable-v1.xml
+struct LayerConfig {
+    enum class Layer : uint32_t { Background, Bottom, Top, Overlay };
+
+    // bitmask
+    enum Anchor : uint32_t {
+        AnchorNone   = 0,
+        AnchorTop    = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP,
+        AnchorBottom = ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM,
+        AnchorLeft   = ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT,
+        AnchorRight  = ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT,
+        AnchorAll    = AnchorTop | AnchorBottom | AnchorLeft | AnchorRight,
+    };
+
+    enum class KeyboardInteractivity : uint32_t { None, Exclusive, OnDemand };
+
+    struct Margin {
+        int32_t top = 0;
+        int32_t right = 0;
+        int32_t bottom = 0;
+        int32_t left = 0;
+    };
+
+    Layer layer = Layer::Overlay;
+    uint32_t anchor = AnchorTop;
+    // 0 stretches the surface between the edges it is anchored to on that axis
+    uint32_t width = 500;
+    uint32_t height = 500;
+    Margin margin { 10, 10, 10, 10 };
+    // > 0 reserves that many pixels from the anchored edge, -1 ignores other surfaces' exclusive zones
+    int32_t exclusive_zone = 0;
+    // OnDemand needs v4 and falls back to None before that
+    KeyboardInteractivity keyboard_interactivity = KeyboardInteractivity::None;
+    // the edge the exclusive zone applies to when anchored to a corner. needs v5, ignored before that
+    Anchor exclusive_edge = AnchorNone;
+    // nullptr lets the compositor choose. only used when the surface is created
+    const WaylandConnection::Output* output = nullptr;
+};
+
+class WaylandWindow : public gfx::Surface {
+    friend WaylandConnection;
+
+    using DrawFn = std::function<void(gfx::Renderer&)>;
+    DrawFn m_draw_fn;
+
+    WaylandConnection& m_connection;
+    // in the order windows were created on the connection
+    uint32_t m_id = 0;
+
+    wl_surface*  m_wl_surface  = nullptr;
+    wl_callback* m_frame_callback = nullptr;
+
+    xdg_surface*  m_xdg_surface  = nullptr;
+    xdg_toplevel* m_xdg_toplevel = nullptr;
+
+    zwlr_layer_surface_v1* m_zwlr_layer_surface = nullptr;
+
+    wp_viewport*            m_wp_viewport         = nullptr;
+    wp_fractional_scale_v1* m_wp_fractional_scale = nullptr;
+
+    // colour the surface is filled with instead of rendering, see set_solid_fill()
+    std::optional<gfx::Color> m_solid_fill;
+    wl_buffer* m_solid_buffer = nullptr;
+
+    wp_tearing_control_v1* m_wp_tearing_control = nullptr;
+    wp_content_type_v1*    m_wp_content_type    = nullptr;
+
+    // surface size in compositor coordinates, the buffer is this times the scale
+    int m_logical_width = 0;
+    int m_logical_height = 0;
+    // in units of 1/120, as used by wp_fractional_scale_v1. 0 if the compositor didn't send one
+    uint32_t m_fractional_scale120 = 0;
+    // from wl_surface.preferred_buffer_scale, 0 if the compositor didn't send one
+    int32_t m_preferred_buffer_scale = 0;
+    // buffer pixels per logical pixel, including the render scale
+    float m_buffer_scale = 1.0f;
+    // the size given to wl_egl_window_resize. the attached size only follows with the next swap
+    int m_buffer_width = 1;
+    int m_buffer_height = 1;
+    // set by anything that affects the buffer size, so the buffer is reallocated at most once per frame
+    bool m_buffer_size_dirty = false;
+
+    // configure events are only recorded and applied at the start of the next frame,
+    // so a burst of them during an interactive resize costs one reallocation
+    struct PendingConfigure {
+        int width = 0;
+        int height = 0;
+        // latest serial, only set once the configure sequence is complete
+        std::optional<uint32_t> serial;
+    } m_pending_configure;
+    // only applied when the buffer can be scaled up through m_wp_viewport
+    util::RenderScale m_render_scale;
+
+    util::FrameProfiler m_frame_profiler;
+    // GL_TIME_ELAPSED queries around the draw function, read back frames later so they never stall
+    bool m_gpu_timing = false;
+    static constexpr size_t m_gpu_query_count = 4;
+    std::array<GLuint, m_gpu_query_count> m_gpu_queries{};
+    // the frame each query measures, empty if it isn't in flight
+    std::array<std::optional<uint64_t>, m_gpu_query_count> m_gpu_query_frames{};
+    // reads back every frame after drawing it, see start_capture()
+    std::optional<capture::Capture> m_capture;
+    // the estimated size of the EGL surfaces of the window, its layers and popups, updated after every frame
+    util::memory::Allocation m_surface_memory { util::memory::Subsystem::Surfaces };
+
+    wl_egl_window* m_egl_window = nullptr;
+    EGLDisplay m_egl_display = nullptr; // owned by the connection
+    EGLSurface m_egl_surface = nullptr;
+    EGLContext m_egl_context = nullptr; // shares objects with the connection's root context
+    EGLConfig  m_egl_config  = nullptr;
+
+    // TODO: initialize gl context in pimpl
+    std::optional<gfx::Renderer> m_renderer;
+
+    enum class Type { Toplevel, LayerSurface } m_type = Type::LayerSurface;
+    LayerConfig m_layer_config;
+    // the first frame is rendered in response to the first configure, after that by frame callbacks
+    bool m_configured = false;
+    // a surface without a buffer is not shown and doesn't get frame callbacks
+    bool m_mapped = false;
+
+public:
+    // async lets the compositor flip as soon as a frame is committed instead of waiting for vblank,
+    // trading tearing for latency. only takes effect if the compositor supports wp_tearing_control_v1
+    enum class PresentationHint { Vsync, Async };
+
+    // lets the compositor pick e.g. a low latency mode for games. wp_content_type_v1 only
+    enum class ContentType { None, Photo, Video, Game };
+
+    // time from submitting a frame to it becoming visible, from wp_presentation feedback
+    struct LatencyStats {
+        uint64_t presented = 0;
+        uint64_t discarded = 0;
+        // presented without waiting for vblank
+        uint64_t torn = 0;
+        std::chrono::nanoseconds total{0};
+        std::chrono::nanoseconds min = std::chrono::nanoseconds::max();
+        std::chrono::nanoseconds max{0};
+
+        [[nodiscard]] std::chrono::nanoseconds mean() const {
+            return presented == 0 ? std::chrono::nanoseconds{0} : total / static_cast<int64_t>(presented);
+        }
+    };
+
+private:
+    Opacity m_opacity;
+    bool m_opaque_region_dirty = true;
+
+    PresentationHint m_presentation_hint = PresentationHint::Vsync;
+
+    struct PendingFeedback {
+        struct wp_presentation_feedback* feedback;
+        // on the presentation clock
+        std::chrono::nanoseconds submitted;
+        PresentationHint hint;
+    };
+    std::vector<PendingFeedback> m_pending_feedback;
+    // separately for each hint, so both can be compared within one run
+    std::array<LatencyStats, 2> m_latency_stats;
+
+public:
+    struct LayerOptions {
+        // position relative to the window, in logical coordinates
+        int x = 0;
+        int y = 0;
+        int width = 0;
+        int height = 0;
+        // re-rendered every frame, otherwise only once and after Layer::invalidate()
+        bool dynamic = false;
+        // presented as a single-pixel buffer instead of calling the draw function, if supported
+        std::optional<gfx::Color> solid_fill;
+    };
+
+    // a part of the window with its own subsurface and buffer, so content that changes at a different
+    // rate than the rest of the window can be rendered and committed on its own
+    class Layer : public gfx::Surface {
+        friend WaylandWindow;
+
+        WaylandWindow& m_window;
+        LayerOptions m_options;
+        DrawFn m_draw_fn;
+        bool m_dirty = true;
+
+        wl_surface*     m_wl_surface     = nullptr;
+        wl_subsurface*  m_wl_subsurface  = nullptr;
+        wp_viewport*    m_wp_viewport    = nullptr;
+        wl_buffer*      m_solid_buffer   = nullptr;
+        wl_egl_window*  m_egl_window     = nullptr;
+        EGLSurface      m_egl_surface    = EGL_NO_SURFACE;
+        std::optional<gfx::Renderer> m_renderer;
+
+    public:
+        Layer(WaylandWindow& window, LayerOptions options, DrawFn draw_fn)
+        : m_window(window)
+        , m_options(options)
+        , m_draw_fn(std::move(draw_fn))
+        {
+            const WaylandConnection& connection = window.m_connection;
+
+            m_wl_surface = wl_compositor_create_surface(connection.m_wl_compositor);
+            m_wl_subsurface = wl_subcompositor_get_subsurface(connection.m_wl_subcompositor, m_wl_surface, window.m_wl_surface);
+            wl_subsurface_set_position(m_wl_subsurface, options.x, options.y);
+
+            // content-only updates of dynamic layers don't have to wait for the parent to commit
+            if (options.dynamic)
+                wl_subsurface_set_desync(m_wl_subsurface);
+
+            if (connection.m_wp_viewporter != nullptr)
+                m_wp_viewport = wp_viewporter_get_viewport(connection.m_wp_viewporter, m_wl_surface);
+
+            if (presents_single_pixel()) return;
+
+            auto [width, height] = buffer_size();
+            m_egl_window = wl_egl_window_create(m_wl_surface, width, height);
+            m_egl_surface = eglCreateWindowSurface(window.m_egl_display, window.m_egl_config, m_egl_window, nullptr);
+            if (m_egl_surface == EGL_NO_SURFACE)
+                throw std::runtime_error("failed to create EGL surface for layer");
+
+            // pacing comes from the window's frame callbacks, swapping must never block on this surface
+            eglMakeCurrent(window.m_egl_display, m_egl_surface, m_egl_surface, window.m_egl_context);
+            eglSwapInterval(window.m_egl_display, 0);
+
+            m_renderer.emplace(*this);
+        }
+
+        Layer(const Layer&) = delete;
+        Layer& operator=(const Layer&) = delete;
+
+        ~Layer() {
+            m_renderer.reset();
+
+            if (m_egl_surface != EGL_NO_SURFACE) {
+                eglMakeCurrent(m_window.m_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_window.m_egl_context);
+                eglDestroySurface(m_window.m_egl_display, m_egl_surface);
+                wl_egl_window_destroy(m_egl_window);
+            }
+
+            if (m_solid_buffer != nullptr) wl_buffer_destroy(m_solid_buffer);
+            if (m_wp_viewport != nullptr) wp_viewport_destroy(m_wp_viewport);
+            wl_subsurface_destroy(m_wl_subsurface);
+            wl_surface_destroy(m_wl_surface);
+        }
+
+        // renders the layer again on the next frame
+        void invalidate() {
+            m_dirty = true;
+        }
+
+        // applied with the next commit of the window
+        void set_position(int x, int y) {
+            m_options.x = x;
+            m_options.y = y;
+            wl_subsurface_set_position(m_wl_subsurface, x, y);
+        }
+
+        [[nodiscard]] int get_width() const override {
+            return buffer_size().first;
+        }
+
+        [[nodiscard]] int get_height() const override {
+            return buffer_size().second;
+        }
+
+    private:
+        [[nodiscard]] bool presents_single_pixel() const {
+            return m_options.solid_fill && m_window.m_connection.m_wp_single_pixel_buffer_manager != nullptr && m_wp_viewport != nullptr;
+        }
+
+        [[nodiscard]] std::pair<int, int> buffer_size() const {
+            float scale = m_wp_viewport != nullptr ? m_window.m_buffer_scale : std::ceil(m_window.m_buffer_scale);
+
+            return {
+                std::max(1l, std::lround(m_options.width * scale)),
+                std::max(1l, std::lround(m_options.height * scale)),
+            };
+        }
+
+        // called by the window when its scale changes
+        void resize() {
+            m_dirty = true;
+            if (m_egl_window == nullptr) return;
+
+            auto [width, height] = buffer_size();
+            wl_egl_window_resize(m_egl_window, width, height, 0, 0);
+
+            if (m_wp_viewport == nullptr && m_window.supports_buffer_scale())
+                wl_surface_set_buffer_scale(m_wl_surface, std::ceil(m_window.m_buffer_scale));
+        }
+
+        void render() {
+            if (!m_options.dynamic && !m_dirty) return;
+            m_dirty = false;
+
+            if (m_wp_viewport != nullptr)
+                wp_viewport_set_destination(m_wp_viewport, m_options.width, m_options.height);
+
+            if (presents_single_pixel()) {
+                if (m_solid_buffer == nullptr) {
+                    m_solid_buffer = m_window.create_solid_buffer(*m_options.solid_fill);
+                    wl_surface_attach(m_wl_surface, m_solid_buffer, 0, 0);
+                    m_window.damage_single_pixel(m_wl_surface);
+                }
+
+                wl_surface_commit(m_wl_surface);
+                return;
+            }
+
+            eglMakeCurrent(m_window.m_egl_display, m_egl_surface, m_egl_surface, m_window.m_egl_context);
+            glViewport(0, 0, get_width(), get_height());
+
+            if (m_options.solid_fill)
+                m_renderer->clear_background(*m_options.solid_fill);
+            else if (m_draw_fn)
+                m_draw_fn(*m_renderer);
+
+            eglSwapBuffers(m_window.m_egl_display, m_egl_surface);
+        }
+
+    };
+
+    // a menu or tooltip placed relative to the window. it renders with the window's GL context and
+    // is only drawn after a configure or invalidate(), so opening one costs a surface and a commit
+    class Popup : public gfx::Surface {
+        friend WaylandWindow;
+
+        WaylandWindow& m_window;
+        DrawFn m_draw_fn;
+        // set by configure and invalidate(), the first frame waits for the initial configure
+        bool m_dirty = false;
+        bool m_configured = false;
+        bool m_dismissed = false;
+
+        int m_logical_width;
+        int m_logical_height;
+        // from xdg_popup.configure, applied once xdg_surface.configure completes the sequence
+        int m_pending_width = 0;
+        int m_pending_height = 0;
+
+        wl_surface*     m_wl_surface     = nullptr;
+        xdg_surface*    m_xdg_surface    = nullptr;
+        xdg_popup*      m_xdg_popup      = nullptr;
+        wp_viewport*    m_wp_viewport    = nullptr;
+        wl_egl_window*  m_egl_window     = nullptr;
+        EGLSurface      m_egl_surface    = EGL_NO_SURFACE;
+        std::optional<gfx::Renderer> m_renderer;
+
+    public:
+        Popup(WaylandWindow& window, const PopupPlacement& placement, DrawFn draw_fn)
+        : m_window(window)
+        , m_draw_fn(std::move(draw_fn))
+        , m_logical_width(placement.width)
+        , m_logical_height(placement.height)
+        {
+            WaylandConnection& connection = window.m_connection;
+
+            m_wl_surface = wl_compositor_create_surface(connection.m_wl_compositor);
+
+            if (connection.m_wp_viewporter != nullptr)
+                m_wp_viewport = wp_viewporter_get_viewport(connection.m_wp_viewporter, m_wl_surface);
+
+            m_xdg_surface = xdg_wm_base_get_xdg_surface(connection.m_xdg_wm_base, m_wl_surface);
+            xdg_surface_add_listener(m_xdg_surface, &m_xdg_surface_listener, this);
+
+            // layer surfaces adopt a popup created without a parent
+            m_xdg_popup = xdg_surface_get_popup(m_xdg_surface, window.m_xdg_surface, connection.positioner(placement));
+            xdg_popup_add_listener(m_xdg_popup, &m_xdg_popup_listener, this);
+
+            if (window.m_zwlr_layer_surface != nullptr)
+                zwlr_layer_surface_v1_get_popup(window.m_zwlr_layer_surface, m_xdg_popup);
+
+            auto [width, height] = buffer_size();
+            m_egl_window = wl_egl_window_create(m_wl_surface, width, height);
+            m_egl_surface = eglCreateWindowSurface(window.m_egl_display, window.m_egl_config, m_egl_window, nullptr);
+            if (m_egl_surface == EGL_NO_SURFACE)
+                throw std::runtime_error("failed to create EGL surface for popup");
+
+            eglMakeCurrent(window.m_egl_display, m_egl_surface, m_egl_surface, window.m_egl_context);
+            eglSwapInterval(window.m_egl_display, 0);
+
+            m_renderer.emplace(*this);
+
+            // a buffer must not be attached before the initial configure is acked
+            wl_surface_commit(m_wl_surface);
+        }
+
+        Popup(const Popup&) = delete;
+        Popup& operator=(const Popup&) = delete;
+
+        ~Popup() {
+            m_renderer.reset();
+
+            eglMakeCurrent(m_window.m_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_window.m_egl_context);
+            eglDestroySurface(m_window.m_egl_display, m_egl_surface);
+            wl_egl_window_destroy(m_egl_window);
+
+            xdg_popup_destroy(m_xdg_popup);
+            xdg_surface_destroy(m_xdg_surface);
+            if (m_wp_viewport != nullptr) wp_viewport_destroy(m_wp_viewport);
+            wl_surface_destroy(m_wl_surface);
+        }
+
+        // renders the popup again on the next frame of the window
+        void invalidate() {
+            m_dirty = true;
+        }
+
+        // the compositor closed the popup, e.g. because the user clicked elsewhere.
+        // it is no longer rendered and should be closed with WaylandWindow::close_popup()
+        [[nodiscard]] bool dismissed() const {
+            return m_dismissed;
+        }
+
+        [[nodiscard]] int get_width() const override {
+            return buffer_size().first;
+        }
+
+        [[nodiscard]] int get_height() const override {
+            return buffer_size().second;
+        }
+
+    private:
+        [[nodiscard]] std::pair<int, int> buffer_size() const {
+            float scale = m_wp_viewport != nullptr ? m_window.m_buffer_scale : std::ceil(m_window.m_buffer_scale);
+
+            return {
+                std::max(1l, std::lround(m_logical_width * scale)),
+                std::max(1l, std::lround(m_logical_height * scale)),
+            };
+        }
+
+        // called by the window when its scale changes
+        void resize() {
+            auto [width, height] = buffer_size();
+            wl_egl_window_resize(m_egl_window, width, height, 0, 0);
+
+            if (m_wp_viewport == nullptr && m_window.supports_buffer_scale())
+                wl_surface_set_buffer_scale(m_wl_surface, std::ceil(m_window.m_buffer_scale));
+
+            m_dirty = m_configured;
+        }
+
+        void render() {
+            if (!m_dirty || m_dismissed) return;
+            m_dirty = false;
+
+            if (m_wp_viewport != nullptr)
+                wp_viewport_set_destination(m_wp_viewport, m_logical_width, m_logical_height);
+
+            eglMakeCurrent(m_window.m_egl_display, m_egl_surface, m_egl_surface, m_window.m_egl_context);
+            glViewport(0, 0, get_width(), get_height());
+
+            if (m_draw_fn)
+                m_draw_fn(*m_renderer);
+
+            eglSwapBuffers(m_window.m_egl_display, m_egl_surface);
+        }
+
+        static inline xdg_popup_listener m_xdg_popup_listener {
+            .configure = [](void* data, [[maybe_unused]] struct xdg_popup* xdg_popup, [[maybe_unused]] int32_t x, [[maybe_unused]] int32_t y, int32_t width, int32_t height) {
+                util::trace::instant("popup configure");
+                Popup& self = *static_cast<Popup*>(data);
+                self.m_pending_width = width;
+                self.m_pending_height = height;
+            },
+            .popup_done = [](void* data, [[maybe_unused]] struct xdg_popup* xdg_popup) {
+                util::trace::instant("popup done");
+                Popup& self = *static_cast<Popup*>(data);
+                self.m_dismissed = true;
+            },
+            .repositioned = util::DefaultConstructedFunction<decltype(xdg_popup_listener::repositioned)>::value,
+        };
+
+        // acks and renders right away, so the popup is shown with the commit of its first frame
+        static inline xdg_surface_listener m_xdg_surface_listener {
+            .configure = [](void* data, struct xdg_surface* xdg_surface, uint32_t serial) {
+                util::trace::instant("configure", "serial", serial);
+                util::trace::Span span("configure");
+                Popup& self = *static_cast<Popup*>(data);
+                xdg_surface_ack_configure(xdg_surface, serial);
+
+                bool resized = self.m_pending_width != self.m_logical_width || self.m_pending_height != self.m_logical_height;
+                if (resized && self.m_pending_width != 0 && self.m_pending_height != 0) {
+                    self.m_logical_width = self.m_pending_width;
+                    self.m_logical_height = self.m_pending_height;
+                    auto [width, height] = self.buffer_size();
+                    wl_egl_window_resize(self.m_egl_window, width, height, 0, 0);
+                }
+
+                self.m_configured = true;
+                self.m_dirty = true;
+                self.render();
+            },
+        };
+    };
+
+private:
+    // stacked in this order above the window surface. unique_ptr, as each layer's renderer refers to it
+    std::vector<std::unique_ptr<Layer>> m_layers;
+    // unique_ptr, as listeners and renderers refer to them
+    std::vector<std::unique_ptr<Popup>> m_popups;
+
+    // outputs the surface is currently shown on
+    std::vector<wl_output*> m_entered_outputs;
+
+public:
+    // for toplevels, only the size of the config is used as the initial size
+    WaylandWindow(WaylandConnection& connection, const char* title, LayerConfig layer_config = {}, Opacity opacity = Opacity::Translucent)
+    : m_connection(connection)
+    , m_egl_display(connection.m_egl_display)
+    , m_layer_config(layer_config)
+    , m_opacity(opacity)
+    {
+        if (m_type == Type::LayerSurface && connection.m_zwlr_layer_shell == nullptr)
+            throw std::runtime_error("compositor does not support zwlr_layer_shell_v1");
+
+        m_wl_surface = wl_compositor_create_surface(connection.m_wl_compositor);
+        wl_surface_add_listener(m_wl_surface, &m_wl_surface_listener, this);
+
+        // only a first guess for the buffer size, the compositor sends the actual size with the first configure
+        const WaylandConnection::Output* output = layer_config.output;
+        bool stretched_to_output = output != nullptr && output->width != 0 && output->height != 0;
+        m_logical_width = layer_config.width != 0 ? layer_config.width : stretched_to_output ? output->width / output->scale : 1;
+        m_logical_height = layer_config.height != 0 ? layer_config.height : stretched_to_output ? output->height / output->scale : 1;
+
+        if (connection.m_wp_viewporter != nullptr)
+            m_wp_viewport = wp_viewporter_get_viewport(connection.m_wp_viewporter, m_wl_surface);
+
+        // fractional scales can only be presented through a viewport
+        if (m_wp_viewport != nullptr && connection.m_wp_fractional_scale_manager != nullptr) {
+            m_wp_fractional_scale = wp_fractional_scale_manager_v1_get_fractional_scale(connection.m_wp_fractional_scale_manager, m_wl_surface);
+            wp_fractional_scale_v1_add_listener(m_wp_fractional_scale, &m_wp_fractional_scale_listener, this);
+        }
+
+        try {
+            if (!init_egl())
+                throw std::runtime_error("failed to initialize EGL");
+
+            m_renderer.emplace(*this);
+        } catch (...) {
+            // the destructor doesn't run for a window that failed to construct
+            eglMakeCurrent(m_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (m_egl_surface != EGL_NO_SURFACE) eglDestroySurface(m_egl_display, m_egl_surface);
+            if (m_egl_window != nullptr) wl_egl_window_destroy(m_egl_window);
+            if (m_egl_context != nullptr) eglDestroyContext(m_egl_display, m_egl_context);
+
+            if (m_wp_fractional_scale != nullptr) wp_fractional_scale_v1_destroy(m_wp_fractional_scale);
+            if (m_wp_viewport != nullptr) wp_viewport_destroy(m_wp_viewport);
+            wl_surface_destroy(m_wl_surface);
+            throw;
+        }
+
+        // only windows that exist count, so a replay matches them in the same order
+        m_id = connection.m_next_window_id++;
+        connection.m_windows.push_back(this);
+
+        if (m_type == Type::Toplevel) {
+            m_xdg_surface = xdg_wm_base_get_xdg_surface(connection.m_xdg_wm_base, m_wl_surface);
+            m_xdg_toplevel = xdg_surface_get_toplevel(m_xdg_surface);
+            xdg_toplevel_set_title(m_xdg_toplevel, title);
+
+            xdg_toplevel_add_listener(m_xdg_toplevel, &m_xdg_toplevel_listener, this);
+            xdg_surface_add_listener(m_xdg_surface, &m_xdg_surface_listener, this);
+        }
+
+        if (m_type == Type::LayerSurface) {
+            struct wl_output* wl_output = output != nullptr ? output->wl_output : nullptr;
+            m_zwlr_layer_surface = zwlr_layer_shell_v1_get_layer_surface(connection.m_zwlr_layer_shell, m_wl_surface, wl_output, static_cast<uint32_t>(layer_config.layer), title);
+            zwlr_layer_surface_v1_add_listener(m_zwlr_layer_surface, &m_zwlr_layer_surface_listener, this);
+
+            send_layer_config();
+        }
+
+        // the initial commit carries all state set above. a buffer must not be attached before the
+        // first configure is acked, which is handled once the event loop runs, without a roundtrip here
+        wl_surface_commit(m_wl_surface);
+    }
+
+    WaylandWindow(const WaylandWindow&) = delete;
+    WaylandWindow& operator=(const WaylandWindow&) = delete;
+
+    // the connection stays usable for other windows
+    ~WaylandWindow() {
+        std::erase(m_connection.m_windows, this);
+
+        // popups have to be destroyed before their parent
+        m_popups.clear();
+        m_layers.clear();
+
+        // surfaceless while the window presents a single-pixel buffer, the GL objects still need the context
+        eglMakeCurrent(m_egl_display, m_egl_surface, m_egl_surface, m_egl_context);
+        m_renderer.reset();
+        stop_capture();
+        if (m_gpu_queries[0] != 0)
+            glDeleteQueries(m_gpu_queries.size(), m_gpu_queries.data());
+
+        if (m_egl_surface != EGL_NO_SURFACE)
+            destroy_egl_surface();
+        eglMakeCurrent(m_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(m_egl_display, m_egl_context);
+
+        // pending callbacks would otherwise be dispatched to a destroyed window
+        for (auto& pending : m_pending_feedback)
+            wp_presentation_feedback_destroy(pending.feedback);
+        if (m_frame_callback != nullptr) wl_callback_destroy(m_frame_callback);
+
+        if (m_solid_buffer != nullptr) wl_buffer_destroy(m_solid_buffer);
+        if (m_wp_tearing_control != nullptr) wp_tearing_control_v1_destroy(m_wp_tearing_control);
+        if (m_wp_content_type != nullptr) wp_content_type_v1_destroy(m_wp_content_type);
+        if (m_wp_fractional_scale != nullptr) wp_fractional_scale_v1_destroy(m_wp_fractional_scale);
+        if (m_wp_viewport != nullptr) wp_viewport_destroy(m_wp_viewport);
+        if (m_zwlr_layer_surface != nullptr) zwlr_layer_surface_v1_destroy(m_zwlr_layer_surface);
+        if (m_xdg_toplevel != nullptr) xdg_toplevel_destroy(m_xdg_toplevel);
+        if (m_xdg_surface != nullptr) xdg_surface_destroy(m_xdg_surface);
+        wl_surface_destroy(m_wl_surface);
+    }
+
+    // adds a layer above all existing ones. static layers are rendered and committed once,
+    // dynamic ones every frame, the window itself is only redrawn if it has a draw function.
+    Layer& add_layer(LayerOptions options, DrawFn draw_fn = {}) {
+        if (m_connection.m_wl_subcompositor == nullptr)
+            throw std::runtime_error("compositor does not support wl_subcompositor");
+
+        return *m_layers.emplace_back(std::make_unique<Layer>(*this, options, std::move(draw_fn)));
+    }
+
+    void remove_layer(Layer& layer) {
+        std::erase_if(m_layers, [&](const auto& other) { return other.get() == &layer; });
+    }
+
+    // the popup is shown once the compositor configured it. popups with the same placement reuse one xdg_positioner
+    Popup& open_popup(const PopupPlacement& placement, DrawFn draw_fn = {}) {
+        return *m_popups.emplace_back(std::make_unique<Popup>(*this, placement, std::move(draw_fn)));
+    }
+
+    void close_popup(Popup& popup) {
+        std::erase_if(m_popups, [&](const auto& other) { return other.get() == &popup; });
+    }
+
+    // buffer pixels per logical pixel, i.e. the preferred scale of the surface times the render scale
+    [[nodiscard]] float get_scale() const {
+        return m_buffer_scale;
+    }
+
+    // renders into a smaller buffer that the compositor scales up, to trade resolution for frame time.
+    // has no effect if the compositor doesn't support wp_viewporter.
+    void set_render_scale(util::RenderScale render_scale) {
+        m_render_scale = render_scale;
+        m_buffer_size_dirty = true;
+    }
+
+    // the time spent in each phase of the most recent frames, readable from any thread
+    [[nodiscard]] const util::FrameProfiler& frame_profiler() const {
+        return m_frame_profiler;
+    }
+
+    // also measures the gpu time of the draw function with timer queries
+    void set_gpu_timing(bool enabled) {
+        m_gpu_timing = enabled;
+    }
+
+    // writes every frame the window draws, read back asynchronously a few frames later.
+    // frames presented as a single-pixel buffer, or only carrying layers, aren't captured
+    void start_capture(capture::Options options) {
+        stop_capture();
+        m_capture.emplace(std::move(options));
+    }
+
+    // writes the frames still in flight and waits for the encoder to finish
+    void stop_capture() {
+        if (!m_capture) return;
+
+        eglMakeCurrent(m_egl_display, m_egl_surface, m_egl_surface, m_egl_context);
+        m_capture->finish();
+        m_capture.reset();
+    }
+
+    [[nodiscard]] std::optional<capture::Stats> capture_stats() {
+        if (!m_capture) return std::nullopt;
+        return m_capture->stats();
+    }
+
+    // can be changed at runtime, but only a window created as opaque renders without alpha
+    void set_opacity(Opacity opacity) {
+        m_opacity = opacity;
+        m_opaque_region_dirty = true;
+    }
+
+    // fills the whole surface with a single colour instead of calling the draw function.
+    // if the compositor supports it, this is presented as a 1x1 buffer scaled up by the viewport,
+    // and the EGL surface is destroyed until the fill is reset, so the surface costs bytes instead of megabytes.
+    void set_solid_fill(std::optional<gfx::Color> color) {
+        bool was_single_pixel = presents_single_pixel();
+        m_solid_fill = color;
+
+        if (m_solid_buffer != nullptr) {
+            wl_buffer_destroy(m_solid_buffer);
+            m_solid_buffer = nullptr;
+        }
+
+        if (!was_single_pixel && presents_single_pixel())
+            destroy_egl_surface();
+
+        if (was_single_pixel && !presents_single_pixel()) {
+            if (!create_egl_surface())
+                throw std::runtime_error("failed to recreate EGL surface");
+            m_buffer_size_dirty = true;
+        }
+    }
+
+    // changes the layer surface with a single commit. the compositor answers with a configure,
+    // a new size is applied with the next frame. the output can't be changed after creation
+    void configure_layer(const LayerConfig& layer_config) {
+        if (m_zwlr_layer_surface == nullptr) return;
+
+        if (layer_config.layer != m_layer_config.layer && zwlr_layer_surface_v1_get_version(m_zwlr_layer_surface) >= ZWLR_LAYER_SURFACE_V1_SET_LAYER_SINCE_VERSION)
+            zwlr_layer_surface_v1_set_layer(m_zwlr_layer_surface, static_cast<uint32_t>(layer_config.layer));
+
+        const WaylandConnection::Output* output = m_layer_config.output;
+        m_layer_config = layer_config;
+        m_layer_config.output = output;
+
+        send_layer_config();
+        wl_surface_commit(m_wl_surface);
+    }
+
+    [[nodiscard]] const LayerConfig& layer_config() const {
+        return m_layer_config;
+    }
+
+    // applied with the next frame
+    void set_presentation_hint(PresentationHint hint) {
+        m_presentation_hint = hint;
+
+        if (m_connection.m_wp_tearing_control_manager != nullptr) {
+            if (m_wp_tearing_control == nullptr)
+                m_wp_tearing_control = wp_tearing_control_manager_v1_get_tearing_control(m_connection.m_wp_tearing_control_manager, m_wl_surface);
+
+            wp_tearing_control_v1_set_presentation_hint(m_wp_tearing_control, hint == PresentationHint::Async
+                ? WP_TEARING_CONTROL_V1_PRESENTATION_HINT_ASYNC
+                : WP_TEARING_CONTROL_V1_PRESENTATION_HINT_VSYNC);
+        }
+    }
+
+    // applied with the next frame
+    void set_content_type(ContentType type) {
+        if (m_connection.m_wp_content_type_manager == nullptr) return;
+
+        if (m_wp_content_type == nullptr)
+            m_wp_content_type = wp_content_type_manager_v1_get_surface_content_type(m_connection.m_wp_content_type_manager, m_wl_surface);
+
+        wp_content_type_v1_set_content_type(m_wp_content_type, static_cast<uint32_t>(type));
+    }
+
+    // only frames rendered through EGL are measured, and only if the compositor supports wp_presentation
+    [[nodiscard]] const LatencyStats& latency_stats(PresentationHint hint) const {
+        return m_latency_stats[static_cast<size_t>(hint)];
+    }
+
+    [[nodiscard]] int get_width() const override {
+        if (m_egl_window == nullptr) return 1;
+        return m_buffer_width;
+    };
+
+    [[nodiscard]] int get_height() const override {
+        if (m_egl_window == nullptr) return 1;
+        return m_buffer_height;
+    };
+
+    // without a draw function, the window surface is left as is and only layers are rendered
+    void set_draw_fn(DrawFn draw_fn) {
+        m_draw_fn = std::move(draw_fn);
+    }
+
+    // shorthand for a single window, other windows on the connection keep being drawn
+    void draw_loop(DrawFn draw_fn = {}) {
+        set_draw_fn(std::move(draw_fn));
+        m_connection.run();
+    }
+
+private:
+    // called by the connection when an output changes its mode or scale, or is unplugged
+    void output_changed(wl_output* wl_output, bool removed) {
+        bool entered = removed
+            ? std::erase(m_entered_outputs, wl_output) != 0
+            : std::ranges::find(m_entered_outputs, wl_output) != m_entered_outputs.end();
+
+        if (entered)
+            m_buffer_size_dirty = true;
+    }
+
+    static void surface_enter(void* data, [[maybe_unused]] struct wl_surface* wl_surface, struct wl_output* wl_output) {
+        util::trace::instant("enter");
+        WaylandWindow& self = *static_cast<WaylandWindow*>(data);
+        self.m_entered_outputs.push_back(wl_output);
+        self.m_buffer_size_dirty = true;
+    }
+
+    static void surface_leave(void* data, [[maybe_unused]] struct wl_surface* wl_surface, struct wl_output* wl_output) {
+        util::trace::instant("leave");
+        WaylandWindow& self = *static_cast<WaylandWindow*>(data);
+        std::erase(self.m_entered_outputs, wl_output);
+        self.m_buffer_size_dirty = true;
+    }
+
+    static void xdg_surface_configure(void* data, [[maybe_unused]] struct xdg_surface* xdg_surface, uint32_t serial) {
+        util::trace::instant("configure", "serial", serial);
+        WaylandWindow& self = *static_cast<WaylandWindow*>(data);
+        self.m_connection.record(replay::EventType::Configure, self.m_id, { self.m_pending_configure.width, self.m_pending_configure.height });
+        self.m_pending_configure.serial = serial;
+        self.handle_first_configure();
+    }
+
+    void handle_first_configure() {
+        if (m_configured) return;
+        m_configured = true;
+        render_frame();
+    }
+
+    static void frame_done(void* data, struct wl_callback* wl_callback, [[maybe_unused]] uint32_t callback_data) {
+        util::trace::instant("frame done");
+        WaylandWindow& self = *static_cast<WaylandWindow*>(data);
+        self.m_connection.record(replay::EventType::Frame, self.m_id);
+
+        wl_callback_destroy(wl_callback);
+        self.m_frame_callback = nullptr;
+        self.render_frame();
+    }
+
+    void render_frame() {
+        using Phase = util::FrameProfiler::Phase;
+        uint64_t frame = m_frame_profiler.begin_frame();
+
+        // each phase runs from the end of the previous one, the first from when the connection woke up
+        auto last = m_connection.m_dispatch_start;
+        auto end_phase = [&](Phase phase) {
+            auto now = util::monotonic_now();
+            m_frame_profiler.add(phase, std::max(now - last, std::chrono::nanoseconds(0)));
+            last = now;
+        };
+        auto end_frame = [&] {
+            update_surface_memory();
+            m_frame_profiler.end_frame();
+            // another window rendered in the same dispatch doesn't count this one as event dispatch
+            m_connection.m_dispatch_start = util::monotonic_now();
+        };
+
+        util::trace::Span frame_span("frame");
+
+        m_frame_callback = wl_surface_frame(m_wl_surface);
+        wl_callback_add_listener(m_frame_callback, &m_frame_callback_listener, this);
+
+        auto start = std::chrono::steady_clock::now();
+
+        // applying the configure the events delivered is part of handling them
+        begin_frame();
+        end_phase(Phase::Dispatch);
+
+        {
+            util::trace::Span span("draw layers");
+
+            // synchronized layers are applied by the commit of the window surface below
+            for (auto& layer : m_layers)
+                layer->render();
+
+            // popups are committed on their own, they aren't synchronized with the window
+            for (auto& popup : m_popups)
+                popup->render();
+        }
+        end_phase(Phase::Draw);
+
+        if (presents_single_pixel()) {
+            present_single_pixel();
+            m_mapped = true;
+            end_phase(Phase::Commit);
+            end_frame();
+            return;
+        }
+
+        // without a draw function the window surface only carries the layers, committing
+        // is enough to apply them and to get the next frame callback
+        if (!m_solid_fill && !m_draw_fn && m_mapped) {
+            wl_surface_commit(m_wl_surface);
+            end_phase(Phase::Commit);
+            end_frame();
+            return;
+        }
+
+        // layers and popups render with the same context, each sets the viewport for its own surface
+        eglMakeCurrent(m_egl_display, m_egl_surface, m_egl_surface, m_egl_context);
+        glViewport(0, 0, get_width(), get_height());
+
+        {
+            util::trace::Span span("draw");
+            bool gpu_query = begin_gpu_query(frame);
+
+            if (m_solid_fill) {
+                m_renderer->clear_background(*m_solid_fill);
+            } else if (m_draw_fn) {
+                m_draw_fn(*m_renderer);
+            } else {
+                glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+                glClear(GL_COLOR_BUFFER_BIT);
+            }
+
+            if (gpu_query)
+                glEndQuery(GL_TIME_ELAPSED);
+        }
+        end_phase(Phase::Draw);
+
+        // reads the back buffer before the swap, which counts as submitting the frame. it already has the
+        // size given to wl_egl_window_resize, the attached size only follows with the swap
+        if (m_capture) {
+            util::trace::Span span("capture");
+            m_capture->capture(m_buffer_width, m_buffer_height);
+        }
+
+        // hands the commands to the driver, so the swap below only measures waiting for a buffer and presenting
+        glFlush();
+        end_phase(Phase::Submit);
+
+        // applies to the commit done by eglSwapBuffers
+        request_presentation_feedback();
+        end_phase(Phase::Commit);
+
+        {
+            util::trace::Span span("swap");
+            eglSwapBuffers(m_egl_display, m_egl_surface);
+        }
+        m_mapped = true;
+        end_phase(Phase::Swap);
+
+        // only the cpu side is measured, gpu-bound frames show up as eglSwapBuffers blocking
+        if (m_render_scale.update(std::chrono::steady_clock::now() - start))
+            m_buffer_size_dirty = true;
+
+        end_frame();
+    }
+
+    void update_surface_memory() {
+        size_t bytes = m_egl_window != nullptr ? util::memory::surface_bytes(get_width(), get_height()) : 0;
+
+        for (const auto& layer : m_layers) {
+            if (layer->m_egl_window != nullptr)
+                bytes += util::memory::surface_bytes(layer->get_width(), layer->get_height());
+        }
+        for (const auto& popup : m_popups) {
+            if (popup->m_egl_window != nullptr)
+                bytes += util::memory::surface_bytes(popup->get_width(), popup->get_height());
+        }
+
+        m_surface_memory.resize(bytes);
+    }
+
+    // called by the connection when it's over its memory budget
+    void trim_memory() {
+        // two buffers still keep the readback asynchronous
+        if (m_capture)
+            m_capture->reduce_depth(2);
+    }
+
+    // starts a timer query for the frame if gpu timing is enabled and one is free, the context must be current
+    bool begin_gpu_query(uint64_t frame) {
+        if (!m_gpu_timing) return false;
+
+        if (m_gpu_queries[0] == 0)
+            glGenQueries(m_gpu_queries.size(), m_gpu_queries.data());
+        collect_gpu_queries();
+
+        auto free = std::ranges::find(m_gpu_query_frames, false, &std::optional<uint64_t>::has_value);
+        if (free == m_gpu_query_frames.end()) return false;
+
+        *free = frame;
+        glBeginQuery(GL_TIME_ELAPSED, m_gpu_queries[free - m_gpu_query_frames.begin()]);
+        return true;
+    }
+
+    // only takes the results that are available, never waits for the gpu
+    void collect_gpu_queries() {
+        for (size_t index = 0; index < m_gpu_queries.size(); ++index) {
+            if (!m_gpu_query_frames[index]) continue;
+
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(m_gpu_queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available == GL_FALSE) continue;
+
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(m_gpu_queries[index], GL_QUERY_RESULT, &elapsed);
+            m_frame_profiler.set_gpu_time(*m_gpu_query_frames[index], std::chrono::nanoseconds(elapsed));
+            m_gpu_query_frames[index].reset();
+        }
+    }
+
+    // the size is only applied once xdg_surface.configure completes the sequence
+    static void xdg_toplevel_configure(void* data, [[maybe_unused]] struct xdg_toplevel* xdg_toplevel, int32_t width, int32_t height, [[maybe_unused]] struct wl_array* states) {
+        util::trace::instant("toplevel configure");
+        WaylandWindow& self = *static_cast<WaylandWindow*>(data);
+        self.m_pending_configure.width = width;
+        self.m_pending_configure.height = height;
+    }
+
+    static void zwlr_layer_surface_v1_configure(void* data, [[maybe_unused]] struct zwlr_layer_surface_v1* zwlr_layer_surface_v1, uint32_t serial, uint32_t width, uint32_t height) {
+        util::trace::instant("configure", "serial", serial);
+        WaylandWindow& self = *static_cast<WaylandWindow*>(data);
+        self.m_connection.record(replay::EventType::Configure, self.m_id, { static_cast<int32_t>(width), static_cast<int32_t>(height) });
+        self.m_pending_configure = { static_cast<int>(width), static_cast<int>(height), serial };
+        self.handle_first_configure();
+    }
+
+    // double-buffered, applied by the next commit. the layer itself is passed on creation or sent by configure_layer()
+    void send_layer_config() {
+        const LayerConfig& config = m_layer_config;
+        uint32_t version = zwlr_layer_surface_v1_get_version(m_zwlr_layer_surface);
+
+        auto keyboard_interactivity = config.keyboard_interactivity;
+        if (keyboard_interactivity == LayerConfig::KeyboardInteractivity::OnDemand && version < 4)
+            keyboard_interactivity = LayerConfig::KeyboardInteractivity::None;
+
+        zwlr_layer_surface_v1_set_size(m_zwlr_layer_surface, config.width, config.height);
+        zwlr_layer_surface_v1_set_anchor(m_zwlr_layer_surface, config.anchor);
+        zwlr_layer_surface_v1_set_margin(m_zwlr_layer_surface, config.margin.top, config.margin.right, config.margin.bottom, config.margin.left);
+        zwlr_layer_surface_v1_set_exclusive_zone(m_zwlr_layer_surface, config.exclusive_zone);
+        zwlr_layer_surface_v1_set_keyboard_interactivity(m_zwlr_layer_surface, static_cast<uint32_t>(keyboard_interactivity));
+
+        if (config.exclusive_edge != LayerConfig::AnchorNone && version >= ZWLR_LAYER_SURFACE_V1_SET_EXCLUSIVE_EDGE_SINCE_VERSION)
+            zwlr_layer_surface_v1_set_exclusive_edge(m_zwlr_layer_surface, config.exclusive_edge);
+    }
+
+    // acks only the latest configure and applies its size
+    void apply_pending_configure() {
+        if (!m_pending_configure.serial) return;
+        util::trace::Span span("configure");
+
+        if (m_xdg_surface != nullptr)
+            xdg_surface_ack_configure(m_xdg_surface, *m_pending_configure.serial);
+
+        if (m_zwlr_layer_surface != nullptr)
+            zwlr_layer_surface_v1_ack_configure(m_zwlr_layer_surface, *m_pending_configure.serial);
+
+        m_pending_configure.serial.reset();
+
+        // a size of zero leaves the choice to us
+        int width = m_pending_configure.width;
+        int height = m_pending_configure.height;
+        if (width == 0 || height == 0) return;
+        if (width == m_logical_width && height == m_logical_height) return;
+
+        m_logical_width = width;
+        m_logical_height = height;
+        m_buffer_size_dirty = true;
+        m_opaque_region_dirty = true;
+    }
+
+    // double-buffered, applied with the commit of the frame being rendered
+    void update_opaque_region() {
+        if (m_opacity == Opacity::Translucent) {
+            wl_surface_set_opaque_region(m_wl_surface, nullptr);
+            return;
+        }
+
+        wl_region* region = wl_compositor_create_region(m_connection.m_wl_compositor);
+        wl_region_add(region, 0, 0, m_logical_width, m_logical_height);
+        wl_surface_set_opaque_region(m_wl_surface, region);
+        wl_region_destroy(region);
+    }
+
+    // everything that changed since the last frame is applied here, before anything is rendered
+    void begin_frame() {
+        apply_pending_configure();
+
+        if (m_buffer_size_dirty) {
+            m_buffer_size_dirty = false;
+            update_buffer_size();
+        }
+
+        if (m_opaque_region_dirty) {
+            m_opaque_region_dirty = false;
+            update_opaque_region();
+        }
+    }
+
+    [[nodiscard]] std::chrono::nanoseconds presentation_clock_now() const {
+        timespec now;
+        clock_gettime(m_connection.m_presentation_clock, &now);
+        return std::chrono::seconds(now.tv_sec) + std::chrono::nanoseconds(now.tv_nsec);
+    }
+
+    void request_presentation_feedback() {
+        if (m_connection.m_wp_presentation == nullptr) return;
+
+        struct wp_presentation_feedback* feedback = wp_presentation_feedback(m_connection.m_wp_presentation, m_wl_surface);
+        wp_presentation_feedback_add_listener(feedback, &m_wp_presentation_feedback_listener, this);
+        m_pending_feedback.push_back({ feedback, presentation_clock_now(), m_presentation_hint });
+    }
+
+    // presented is std::nullopt if the frame was discarded
+    void finish_feedback(struct wp_presentation_feedback* feedback, std::optional<std::chrono::nanoseconds> presented, uint32_t flags) {
+        auto pending = std::ranges::find(m_pending_feedback, feedback, &PendingFeedback::feedback);
+        assert(pending != m_pending_feedback.end());
+
+        LatencyStats& stats = m_latency_stats[static_cast<size_t>(pending->hint)];
+
+        if (presented) {
+            // the compositor may report a time slightly before our timestamp when it flips immediately
+            auto latency = std::max(std::chrono::nanoseconds{0}, *presented - pending->submitted);
+            stats.presented++;
+            stats.total += latency;
+            stats.min = std::min(stats.min, latency);
+            stats.max = std::max(stats.max, latency);
+            if (!(flags & WP_PRESENTATION_FEEDBACK_KIND_VSYNC))
+                stats.torn++;
+        } else {
+            stats.discarded++;
+        }
+
+        m_pending_feedback.erase(pending);
+        wp_presentation_feedback_destroy(feedback);
+    }
+
+    [[nodiscard]] uint32_t preferred_scale120() const {
+        if (m_fractional_scale120 != 0)
+            return m_fractional_scale120;
+
+        if (m_preferred_buffer_scale != 0)
+            return m_preferred_buffer_scale * 120;
+
+        // compositors without wl_surface v6 only tell us which outputs we are on
+        int32_t scale = 1;
+        for (wl_output* wl_output : m_entered_outputs) {
+            if (const WaylandConnection::Output* output = m_connection.find_output(wl_output))
+                scale = std::max(scale, output->scale);
+        }
+
+        return scale * 120;
+    }
+
+    // wl_surface.set_buffer_scale needs wl_compositor v3, before it every buffer is presented at scale 1
+    [[nodiscard]] bool supports_buffer_scale() const {
+        return m_connection.m_capabilities.compositor_version >= WL_SURFACE_SET_BUFFER_SCALE_SINCE_VERSION;
+    }
+
+    // resizes the buffer to the physical pixel size of the surface, so the compositor
+    // never has to resample it and we never allocate more pixels than are shown
+    void update_buffer_size() {
+        uint32_t scale120 = preferred_scale120();
+        int width = m_logical_width;
+        int height = m_logical_height;
+        float scale = 1.0f;
+
+        if (m_wp_viewport != nullptr) {
+            // rounded half away from zero, as required by wp_fractional_scale_v1
+            scale = scale120 / 120.0f * m_render_scale.get();
+            width = std::max(1l, std::lround(m_logical_width * scale));
+            height = std::max(1l, std::lround(m_logical_height * scale));
+            wp_viewport_set_destination(m_wp_viewport, m_logical_width, m_logical_height);
+
+        } else if (supports_buffer_scale()) {
+            // without a viewport only integer scales can be presented
+            int32_t buffer_scale = (scale120 + 119) / 120;
+            scale = buffer_scale;
+            width *= buffer_scale;
+            height *= buffer_scale;
+            wl_surface_set_buffer_scale(m_wl_surface, buffer_scale);
+        }
+
+        m_buffer_scale = scale;
+        m_buffer_width = width;
+        m_buffer_height = height;
+
+        for (auto& layer : m_layers)
+            layer->resize();
+
+        for (auto& popup : m_popups)
+            popup->resize();
+
+        // destroyed while the window presents a single-pixel buffer
+        if (m_egl_window == nullptr) return;
+
+        // the new size and scale are applied by the commit in the next eglSwapBuffers
+        wl_egl_window_resize(m_egl_window, width, height, 0, 0);
+    }
+
+    [[nodiscard]] bool presents_single_pixel() const {
+        return m_solid_fill && m_connection.m_wp_single_pixel_buffer_manager != nullptr && m_wp_viewport != nullptr;
+    }
+
+    // converts an 8 bit channel to the full 32 bit range, premultiplied by alpha
+    [[nodiscard]] static constexpr uint32_t expand_channel(uint8_t value, uint8_t alpha) {
+        return static_cast<uint32_t>(value * alpha / 255) * 0x01010101;
+    }
+
+    [[nodiscard]] wl_buffer* create_solid_buffer(const gfx::Color& color) const {
+        wl_buffer* buffer = wp_single_pixel_buffer_manager_v1_create_u32_rgba_buffer(
+            m_connection.m_wp_single_pixel_buffer_manager,
+            expand_channel(color.r, color.a),
+            expand_channel(color.g, color.a),
+            expand_channel(color.b, color.a),
+            expand_channel(color.a, 255)
+        );
+        wl_buffer_add_listener(buffer, &m_solid_buffer_listener, nullptr);
+        return buffer;
+    }
+
+    // wl_surface.damage_buffer needs wl_compositor v4, before that damage is in surface coordinates,
+    // which the viewport stretches the pixel over
+    void damage_single_pixel(wl_surface* surface) const {
+        if (m_connection.m_capabilities.compositor_version >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION)
+            wl_surface_damage_buffer(surface, 0, 0, 1, 1);
+        else
+            wl_surface_damage(surface, 0, 0, std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max());
+    }
+
+    void present_single_pixel() {
+        if (m_solid_buffer == nullptr) {
+            m_solid_buffer = create_solid_buffer(*m_solid_fill);
+            wl_surface_attach(m_wl_surface, m_solid_buffer, 0, 0);
+            damage_single_pixel(m_wl_surface);
+        }
+
+        // the logical size may have changed since the last frame
+        wp_viewport_set_destination(m_wp_viewport, m_logical_width, m_logical_height);
+        wl_surface_commit(m_wl_surface);
+    }
+
+    void destroy_egl_surface() {
+        eglMakeCurrent(m_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_egl_context);
+        eglDestroySurface(m_egl_display, m_egl_surface);
+        wl_egl_window_destroy(m_egl_window);
+
+        m_egl_surface = EGL_NO_SURFACE;
+        m_egl_window = nullptr;
+    }
+
+    // returns true on success
+    [[nodiscard]] bool create_egl_surface() {
+        m_egl_window = wl_egl_window_create(m_wl_surface, m_logical_width, m_logical_height);
+        if (m_egl_window == EGL_NO_SURFACE) return false;
+
+        m_buffer_width = m_logical_width;
+        m_buffer_height = m_logical_height;
+
+        m_egl_surface = eglCreateWindowSurface(m_egl_display, m_egl_config, m_egl_window, nullptr);
+        if (!eglMakeCurrent(m_egl_display, m_egl_surface, m_egl_surface, m_egl_context)) return false;
+
+        // frames are paced by our own frame callbacks. blocking in eglSwapBuffers would stall
+        // every other window on the connection, e.g. a 60 Hz output throttling a 144 Hz one
+        eglSwapInterval(m_egl_display, 0);
+        return true;
+    }
+
+    // returns true on success
+    [[nodiscard]] bool init_egl() {
+        m_egl_config = m_connection.choose_config(m_opacity);
+        if (m_egl_config == nullptr) return false;
+
+        // each window has its own context for its own GL state, textures and shaders are shared
+        m_egl_context = eglCreateContext(m_egl_display, m_egl_config, m_connection.m_egl_context, WaylandConnection::m_egl_context_attribs.data());
+        if (m_egl_context == EGL_NO_CONTEXT) return false;
+
+        return create_egl_surface();
+    }
+
+    static inline zwlr_layer_surface_v1_listener m_zwlr_layer_surface_listener {
+        .configure = zwlr_layer_surface_v1_configure,
+        .closed = util::DefaultConstructedFunction<decltype(zwlr_layer_surface_v1_listener::closed)>::value,
+    };
+
+    static inline xdg_surface_listener m_xdg_surface_listener {
+        .configure = xdg_surface_configure,
+    };
+
+    static inline wl_surface_listener m_wl_surface_listener {
+        .enter                      = surface_enter,
+        .leave                      = surface_leave,
+        .preferred_buffer_scale     = [](void* data, [[maybe_unused]] struct wl_surface* wl_surface, int32_t factor) {
+            util::trace::instant("preferred buffer scale", "scale", factor);
+            WaylandWindow& self = *static_cast<WaylandWindow*>(data);
+            self.m_connection.record(replay::EventType::PreferredScale, self.m_id, { factor });
+            self.m_preferred_buffer_scale = factor;
+            self.m_buffer_size_dirty = true;
+        },
+        .preferred_buffer_transform = util::DefaultConstructedFunction<decltype(wl_surface_listener::preferred_buffer_transform)>::value,
+    };
+
+    static inline wp_fractional_scale_v1_listener m_wp_fractional_scale_listener {
+        .preferred_scale = [](void* data, [[maybe_unused]] struct wp_fractional_scale_v1* wp_fractional_scale_v1, uint32_t scale) {
+            util::trace::instant("preferred scale", "scale120", scale);
+            WaylandWindow& self = *static_cast<WaylandWindow*>(data);
+            self.m_connection.record(replay::EventType::FractionalScale, self.m_id, { static_cast<int32_t>(scale) });
+            self.m_fractional_scale120 = scale;
+            self.m_buffer_size_dirty = true;
+        },
+    };
+
+    static inline wp_presentation_feedback_listener m_wp_presentation_feedback_listener {
+        .sync_output = util::DefaultConstructedFunction<decltype(wp_presentation_feedback_listener::sync_output)>::value,
+        .presented = [](void* data, struct wp_presentation_feedback* feedback, uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec,
+                        [[maybe_unused]] uint32_t refresh, [[maybe_unused]] uint32_t seq_hi, [[maybe_unused]] uint32_t seq_lo, uint32_t flags) {
+            util::trace::instant("presented");
+            WaylandWindow& self = *static_cast<WaylandWindow*>(data);
+            uint64_t seconds = static_cast<uint64_t>(tv_sec_hi) << 32 | tv_sec_lo;
+            self.finish_feedback(feedback, std::chrono::seconds(seconds) + std::chrono::nanoseconds(tv_nsec), flags);
+        },
+        .discarded = [](void* data, struct wp_presentation_feedback* feedback) {
+            util::trace::instant("discarded");
+            WaylandWindow& self = *static_cast<WaylandWindow*>(data);
+            self.finish_feedback(feedback, std::nullopt, 0);
+        },
+    };
+
+    // the buffer stays attached and is reused, the release is only traced
+    static inline wl_buffer_listener m_solid_buffer_listener {
+        .release = []([[maybe_unused]] void* data, [[maybe_unused]] struct wl_buffer* wl_buffer) {
+            util::trace::instant("release");
+        },
+    };
+
+    static inline wl_callback_listener m_frame_callback_listener {
+        .done = frame_done,
+    };
+
+    static inline xdg_toplevel_listener m_xdg_toplevel_listener {
+        .configure        = xdg_toplevel_configure,
+        .close            = util::DefaultConstructedFunction<decltype(xdg_toplevel_listener::close)>::value,
+        .configure_bounds = util::DefaultConstructedFunction<decltype(xdg_toplevel_listener::configure_bounds)>::value,
+        .wm_capabilities  = util::DefaultConstructedFunction<decltype(xdg_toplevel_listener::wm_capabilities)>::value,
+    };
+
+};
+
+inline void WaylandConnection::remove_output(uint32_t name) {
+    auto it = std::ranges::find(m_outputs, name, [](const auto& output) { return output->name; });
+    if (it == m_outputs.end()) return;
+
+    Output& output = **it;
+
+    for (WaylandWindow* window : m_windows)
+        window->output_changed(output.wl_output, true);
+
+    if (output.announced) {
+        for (const auto& [id, output_fn] : m_output_fns)
+            output_fn(output, OutputEvent::Removed);
+    }
+
+    if (wl_output_get_version(output.wl_output) >= WL_OUTPUT_RELEASE_SINCE_VERSION)
+        wl_output_release(output.wl_output);
+    else
+        wl_output_destroy(output.wl_output);
+
+    m_outputs.erase(it);
+}
+
+inline void WaylandConnection::report_if_requested() {
+    if (!m_report_requested.exchange(false, std::memory_order_relaxed)) return;
+
+    for (size_t index = 0; index < m_windows.size(); ++index) {
+        std::print(stderr, "window {}: {}", index, util::FrameProfiler::format(m_windows[index]->frame_profiler().summary()));
+        if (auto stats = m_windows[index]->capture_stats())
+            std::print(stderr, "{}", capture::format(*stats));
+    }
+    std::print(stderr, "{}", util::memory::format(util::memory::usage(), m_memory_budget));
+
+    if constexpr (util::protocol_stats::enabled) {
+        auto snapshot = util::protocol_stats::snapshot();
+        std::print(stderr, "{}", util::protocol_stats::format(snapshot, m_protocol_snapshot));
+        m_protocol_snapshot = std::move(snapshot);
+    }
+}
+
+inline void WaylandConnection::trim_memory() {
+    for (auto& [placement, positioner] : m_positioners)
+        xdg_positioner_destroy(positioner);
+    m_positioners.clear();
+
+    for (WaylandWindow* window : m_windows)
+        window->trim_memory();
+}
+
+inline void WaylandConnection::announce_output(Output& output) {
+    OutputEvent event = output.announced ? OutputEvent::Changed : OutputEvent::Added;
+    output.announced = true;
+
+    for (const auto& [id, output_fn] : m_output_fns)
+        output_fn(output, event);
+
+    if (event == OutputEvent::Changed) {
+        for (WaylandWindow* window : m_windows)
+            window->output_changed(output.wl_output, false);
+    }
+}
+
+
+// one fullscreen layer surface per output, each sized to its output and paced by its own frame callbacks,
+// so outputs with different refresh rates don't throttle each other. follows outputs being plugged in and out.
+class OutputOverlay {
+public:
+    using DrawFn = std::function<void(gfx::Renderer&, const WaylandConnection::Output&)>;
+
+private:
+    WaylandConnection& m_connection;
+    std::string m_name_space;
+    Opacity m_opacity;
+    DrawFn m_draw_fn;
+
+    // by registry name of the output
+    std::vector<std::pair<uint32_t, std::unique_ptr<WaylandWindow>>> m_windows;
+    WaylandConnection::OutputFnId m_output_fn_id;
+
+public:
+    OutputOverlay(WaylandConnection& connection, const char* name_space, Opacity opacity, DrawFn draw_fn)
+    : m_connection(connection)
+    , m_name_space(name_space)
+    , m_opacity(opacity)
+    , m_draw_fn(std::move(draw_fn))
+    {
+        for (const auto& output : connection.outputs()) {
+            if (output->announced)
+                add_window(*output);
+        }
+
+        m_output_fn_id = connection.on_output_change([this](const WaylandConnection::Output& output, WaylandConnection::OutputEvent event) {
+            using enum WaylandConnection::OutputEvent;
+
+            if (event == Added)
+                add_window(output);
+
+            // destroyed before the wl_output is released, which would make the compositor close the surface anyway
+            if (event == Removed)
+                std::erase_if(m_windows, [&](const auto& entry) { return entry.first == output.name; });
+        });
+    }
+
+    OutputOverlay(const OutputOverlay&) = delete;
+    OutputOverlay& operator=(const OutputOverlay&) = delete;
+
+    ~OutputOverlay() {
+        m_connection.remove_output_fn(m_output_fn_id);
+    }
+
+    // the window covering the given output, nullptr if there is none
+    [[nodiscard]] WaylandWindow* window(const WaylandConnection::Output& output) const {
+        auto it = std::ranges::find(m_windows, output.name, [](const auto& entry) { return entry.first; });
+        return it == m_windows.end() ? nullptr : it->second.get();
+    }
+
+private:
+    void add_window(const WaylandConnection::Output& output) {
+        auto& window = m_windows.emplace_back(output.name, std::make_unique<WaylandWindow>(m_connection, m_name_space.c_str(), LayerConfig {
+            .anchor = LayerConfig::AnchorAll,
+            .width = 0,
+            .height = 0,
+            .margin = {},
+            .output = &output,
+        }, m_opacity)).second;
+
+        // outputs are owned by unique_ptr and outlive their window, so the reference stays valid
+        window->set_draw_fn([this, &output](gfx::Renderer& renderer) {
+            m_draw_fn(renderer, output);
+        });
+    }
+};
+
+} // namespace wayland